@@ -0,0 +1,289 @@
+/*
+ * @Description  : counting global allocation operators (ALLOC_STATS=1 only)
+ */
+
+#include "alloc_stats.h"
+
+#ifdef ASSEMBLER_ALLOC_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kSiteDepth = 12;      // 每个调用点记录的栈帧数
+const int kSiteSlots = 4096;    // 调用点哈希表容量(2的幂)
+const int kTopSites = 10;       // 报告中列出的调用点数
+const size_t kHeaderSize = 16;  // 块头保存申请大小, 保持16字节对齐
+
+struct PhaseCounter {
+    unsigned long long allocations;
+    unsigned long long bytes;
+    long long peak_live;
+};
+
+struct CallSite {
+    void *frames[kSiteDepth];
+    int depth;
+    unsigned long long allocations;
+    unsigned long long bytes;
+};
+
+// All counters are only touched while holding gLock; the tables are plain
+// POD so that no allocation ever happens inside the hooks themselves.
+std::atomic_flag gLock = ATOMIC_FLAG_INIT;
+PhaseCounter gPhases[PHASE_COUNT];
+CallSite gSites[kSiteSlots];
+long long gLiveBytes = 0;
+unsigned long long gDroppedSites = 0;
+
+thread_local AllocPhase tPhase = PHASE_NONE;
+thread_local bool tInHook = false;  // backtrace()首次调用会申请内存, 防止递归
+
+const char *const kPhaseNames[PHASE_COUNT] = {
+    "other", "read", "label split", "pass 1", "pass 2", "write",
+};
+
+void Lock() {
+    while (gLock.test_and_set(std::memory_order_acquire)) {
+    }
+}
+
+void Unlock() {
+    gLock.clear(std::memory_order_release);
+}
+
+size_t HashFrames(void *const *frames, int depth) {
+    uintptr_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < depth; ++i) {
+        hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+void RecordSite(void *const *frames, int depth, size_t size) {
+    size_t slot = HashFrames(frames, depth) & (kSiteSlots - 1);
+    for (int probe = 0; probe < kSiteSlots; ++probe) {
+        CallSite &site = gSites[slot];
+        if (site.depth == 0) {
+            std::copy(frames, frames + depth, site.frames);
+            site.depth = depth;
+        }
+        if (site.depth == depth && std::equal(frames, frames + depth, site.frames)) {
+            site.allocations += 1;
+            site.bytes += size;
+            return;
+        }
+        slot = (slot + 1) & (kSiteSlots - 1);
+    }
+    gDroppedSites += 1;
+}
+
+void *CountedAlloc(size_t size) {
+    void *frames[kSiteDepth + 2];
+    int depth = 0;
+    if (!tInHook) {
+        tInHook = true;
+        // skip CountedAlloc and operator new themselves
+        depth = backtrace(frames, kSiteDepth + 2) - 2;
+        tInHook = false;
+    }
+
+    char *block = static_cast<char *>(std::malloc(size + kHeaderSize));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t *>(block) = size;
+
+    Lock();
+    PhaseCounter &phase = gPhases[tPhase];
+    phase.allocations += 1;
+    phase.bytes += size;
+    gLiveBytes += size;
+    phase.peak_live = std::max(phase.peak_live, gLiveBytes);
+    if (depth > 0) {
+        RecordSite(frames + 2, depth, size);
+    }
+    Unlock();
+    return block + kHeaderSize;
+}
+
+void CountedFree(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    char *block = static_cast<char *>(ptr) - kHeaderSize;
+    Lock();
+    gLiveBytes -= *reinterpret_cast<size_t *>(block);
+    Unlock();
+    std::free(block);
+}
+
+void *ThrowingAlloc(size_t size) {
+    void *ptr = CountedAlloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// Name one frame as "symbol" or "object+0xoffset" (feed the latter to addr2line)
+std::string FrameName(void *frame) {
+    Dl_info info;
+    if (dladdr(frame, &info) == 0) {
+        return "?";
+    }
+    if (info.dli_sname != nullptr) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name.substr(0, name.find('('));  // 参数列表对定位调用点没有帮助
+    }
+    const char *object = info.dli_fname != nullptr ? info.dli_fname : "?";
+    const char *base = std::strrchr(object, '/');
+    char offset[32];
+    std::snprintf(offset, sizeof(offset), "+0x%lx",
+                  (unsigned long)(static_cast<char *>(frame) - static_cast<char *>(info.dli_fbase)));
+    return std::string(base != nullptr ? base + 1 : object) + offset;
+}
+
+// Frames inside the standard library or the allocator are not interesting
+// call sites; the first frame outside them is the one to blame.
+bool IsLibraryFrame(const std::string &name) {
+    return name.compare(0, 12, "operator new") == 0 || name.find("std::") != std::string::npos ||
+           name.find("__gnu_cxx::") != std::string::npos;
+}
+
+} // namespace
+
+AllocPhaseScope::AllocPhaseScope(AllocPhase phase) : saved_(tPhase) {
+    tPhase = phase;
+}
+
+AllocPhaseScope::~AllocPhaseScope() {
+    tPhase = saved_;
+}
+
+void ReportAllocStats(std::ostream &os) {
+    // Reserve outside the lock: the reservation itself goes through the hooks,
+    // and sites recorded meanwhile are simply left out of the snapshot
+    size_t used = 0;
+    Lock();
+    for (const auto &site : gSites) {
+        used += site.depth != 0;
+    }
+    Unlock();
+    std::vector<CallSite> sites;
+    sites.reserve(used);
+    PhaseCounter phases[PHASE_COUNT];
+    Lock();
+    std::copy(gPhases, gPhases + PHASE_COUNT, phases);
+    for (const auto &site : gSites) {
+        if (site.depth != 0 && sites.size() < used) {
+            sites.push_back(site);
+        }
+    }
+    Unlock();
+
+    os << "== allocation stats ==" << std::endl;
+    os << "phase          allocs        bytes    peak live" << std::endl;
+    for (int i = PHASE_READ; i < PHASE_COUNT; ++i) {
+        char row[96];
+        std::snprintf(row, sizeof(row), "%-11s %9llu %12llu %12lld", kPhaseNames[i],
+                      phases[i].allocations, phases[i].bytes, phases[i].peak_live);
+        os << row << std::endl;
+    }
+    char row[96];
+    std::snprintf(row, sizeof(row), "%-11s %9llu %12llu %12lld", kPhaseNames[PHASE_NONE],
+                  phases[PHASE_NONE].allocations, phases[PHASE_NONE].bytes,
+                  phases[PHASE_NONE].peak_live);
+    os << row << std::endl;
+
+    // Fold stacks that end up in the same caller into one call site
+    std::map<std::string, std::pair<unsigned long long, unsigned long long>> owners;
+    for (const auto &site : sites) {
+        int owner = 0;
+        std::string name;
+        for (; owner < site.depth; ++owner) {
+            name = FrameName(site.frames[owner]);
+            if (!IsLibraryFrame(name)) {
+                break;
+            }
+        }
+        if (owner + 1 < site.depth) {
+            name += "  <-  " + FrameName(site.frames[owner + 1]);
+        }
+        owners[name].first += site.allocations;
+        owners[name].second += site.bytes;
+    }
+    std::vector<std::pair<std::string, std::pair<unsigned long long, unsigned long long>>> ranked(
+        owners.begin(), owners.end());
+    std::sort(ranked.begin(), ranked.end(), [](const decltype(ranked)::value_type &a,
+                                               const decltype(ranked)::value_type &b) {
+        return a.second.first > b.second.first;
+    });
+    os << "top call sites (by allocation count):" << std::endl;
+    for (int i = 0; i < kTopSites && i < (int)ranked.size(); ++i) {
+        char counts[64];
+        std::snprintf(counts, sizeof(counts), "%9llu %12llu  ", ranked[i].second.first,
+                      ranked[i].second.second);
+        os << counts << ranked[i].first << std::endl;
+    }
+    if (gDroppedSites != 0) {
+        os << "  (" << gDroppedSites << " allocations from untracked sites)" << std::endl;
+    }
+}
+
+void *operator new(size_t size) {
+    return ThrowingAlloc(size);
+}
+
+void *operator new[](size_t size) {
+    return ThrowingAlloc(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return CountedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return CountedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    CountedFree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    CountedFree(ptr);
+}
+
+#endif
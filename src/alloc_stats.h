@@ -0,0 +1,55 @@
+/*
+ * @Description  : optional heap allocation accounting per assembly phase
+ *
+ * Build with `make ALLOC_STATS=1` (after `make clean`) to replace the global
+ * allocation operators with counting versions. Without that flag every hook
+ * below compiles to nothing.
+ */
+
+#ifndef ASSEMBLER_ALLOC_STATS_H
+#define ASSEMBLER_ALLOC_STATS_H
+
+#include <ostream>
+
+enum AllocPhase
+{
+    PHASE_NONE,        // 未归属任何阶段
+    PHASE_READ,        // 读取源文件
+    PHASE_LABEL_SPLIT, // 分离标签
+    PHASE_PASS1,       // 第一遍扫描
+    PHASE_PASS2,       // 第二遍扫描(转译)
+    PHASE_WRITE,       // 写出结果文件
+    PHASE_COUNT
+}; // 枚举汇编阶段
+
+#ifdef ASSEMBLER_ALLOC_STATS
+
+// Attribute allocations made by the current thread to `phase` while in scope
+class AllocPhaseScope
+{
+private:
+    AllocPhase saved_;
+
+public:
+    explicit AllocPhaseScope(AllocPhase phase);
+    ~AllocPhaseScope();
+    AllocPhaseScope(const AllocPhaseScope &) = delete;
+    AllocPhaseScope &operator=(const AllocPhaseScope &) = delete;
+};
+
+// Print per-phase counters and the top allocation call sites
+void ReportAllocStats(std::ostream &os);
+
+#else
+
+class AllocPhaseScope
+{
+public:
+    explicit AllocPhaseScope(AllocPhase) {}
+};
+
+inline void ReportAllocStats(std::ostream &) {}
+
+#endif
+
+#endif
@@ -7,12 +7,27 @@
  */
 
 #include "assembler.h"
+#include "alloc_stats.h"
+#include "parallel.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <map>
 #include <string>
+#include <sys/mman.h>
+#include <unistd.h>
 
 // add label and its address to symbol table
 void LabelMapType::AddLabel(const std::string &str, const unsigned address) {
     labels_.insert({str, address});
 }
+// move an existing label (watch mode shifts labels after an edit)
+void LabelMapType::SetAddress(const std::string &str, const unsigned address) {
+    labels_[str] = address;
+}
+void LabelMapType::Clear() {
+    labels_.clear();
+}
 // locate the address of label in symbol table
 int LabelMapType::GetAddress(const std::string &str) const {
     if (labels_.find(str) == labels_.end()) {
@@ -26,6 +41,21 @@ std::string assembler::TranslateOprand(unsigned int current_address, std::string
     // Translate the oprand
     str = Trim(str);
     auto item = label_map.GetAddress(str);
+    bool is_external = item == -1 && externals.count(str) != 0;
+    if (object != nullptr &&
+        (is_external || (item != -1 && label_sections.at(str) != translate_section))) {
+        // Another section or module: leave the field zero and let the linker
+        // patch it once every section has been placed
+        object->relocations.push_back(
+            {translate_section, current_address - sections[translate_section].origin,
+             opcode_length, str});
+        return std::string(opcode_length, '0');
+    }
+    if (is_external) {
+        // @ Error external label can only be resolved by the linker
+        translate_status = -31;
+        return std::string(opcode_length, '0');
+    }
     if (item != -1) { //操作数是标签
         // str is a label
         // TO BE DONE
@@ -35,7 +65,7 @@ std::string assembler::TranslateOprand(unsigned int current_address, std::string
         addr.erase(0,16-opcode_length);
         return addr;
     }
-    if (str[0] == 'R') { //操作数是寄存器
+    if (str.size() == 2 && str[0] == 'R' && str[1] >= '0' && str[1] <= '7') { //操作数是寄存器
         // str is a register
         // TO BE DONE
         std::string reg = NumberToAssemble(str[1]-'0');
@@ -46,7 +76,13 @@ std::string assembler::TranslateOprand(unsigned int current_address, std::string
     else {  //操作数是立即数
         // str is an immediate number
         // TO BE DONE
-        std::string imm = NumberToAssemble(RecognizeNumberValue(str));
+        auto value = RecognizeNumberValue(str);
+        if (value == std::numeric_limits<int>::max()) {
+            // @ Error neither a register, a label nor a number
+            translate_status = -32;
+            return std::string(opcode_length, '0');
+        }
+        std::string imm = NumberToAssemble(value);
         //printf("imm :%d\n",opcode_length);
         imm.erase(0,16-opcode_length);
         return imm;
@@ -64,6 +100,7 @@ std::string assembler::LineLabelSplit(const std::string &line, int current_addre
         // save it in label_map
         // TO BE DONE
         label_map.AddLabel(first_token,current_address);
+        label_sections.insert({first_token, sections.size() - 1});
         // remove label from the line
         if (first_whitespace_position == std::string::npos) { //该行只包含标签
             // nothing else in the line
@@ -75,27 +112,92 @@ std::string assembler::LineLabelSplit(const std::string &line, int current_addre
     return line;
 }
 
-// Scan #1: save commands and labels with their addresses
+namespace {
+
+// Whether a formatted line is a .ORIG, with or without a label in front;
+// nothing is recorded, the line may still be skipped
+bool IsOrigLine(const std::string &line) {
+    auto first_whitespace_position = line.find(' ');
+    auto token = line.substr(0, first_whitespace_position);
+    if (IsLC3Pseudo(token) == -1 && IsLC3Command(token) == -1 && IsLC3TrapRoutine(token) == -1 &&
+        first_whitespace_position != std::string::npos) {
+        std::string command = line.substr(first_whitespace_position + 1);
+        command = Trim(command);
+        token = command.substr(0, command.find(' '));
+    }
+    return token == ".ORIG";
+}
+
+} // namespace
+
+// Scan #1 over a file, or stdin for "-"; the source is read into memory once
 int assembler::firstPass(std::string &input_filename) {
-    std::string line;
-    std::ifstream input_file(input_filename);
-    if (!input_file.is_open()) {
-        std::cout << "Unable to open file" << std::endl;
+    InputBuffer input;
+    int open_status;
+    {
+        AllocPhaseScope read_phase(PHASE_READ);
+        open_status = input.open(input_filename, options.limits.max_input_bytes);
+    }
+    if (open_status == -2) {
+        // @ Error input larger than the job allows
+        return -41;
+    }
+    if (open_status != 0) {
+        std::cerr << "Unable to open file" << std::endl;
         // @ Input file read error
         return -1;
     }
+    MemoryStreambuf source(input.data(), input.size());
+    std::istream input_stream(&source);
+    return firstPass(input_stream);
+}
+
+// Scan #1: save commands and labels with their addresses
+int assembler::firstPass(std::istream &input_file) {
+    AllocPhaseScope pass_phase(PHASE_PASS1);
+    std::string line;
 
     int orig_address = -1;
     int current_address = -1;
+    bool section_ended = false; // .END之后只接受新的.ORIG
+    size_t input_bytes = 0;     // 已读入的字节数
+    size_t output_words = 0;    // 已占用的字数
+    size_t line_count = 0;
 
-    while (std::getline(input_file, line)) { //逐行读取文件
+    while (true) { //逐行读取文件
+        {
+            AllocPhaseScope read_phase(PHASE_READ);
+            if (!std::getline(input_file, line)) {
+                break;
+            }
+        }
+        // Budget: sizes on every line, clock and cancellation now and then
+        input_bytes += line.size() + 1;
+        if (options.limits.max_input_bytes != 0 && input_bytes > options.limits.max_input_bytes) {
+            // @ Error input larger than the job allows
+            return -41;
+        }
+        auto limit_status = OutputWordsStatus(output_words);
+        if (limit_status == 0 && ++line_count % kLimitCheckInterval == 0) {
+            limit_status = LimitStatus();
+        }
+        if (limit_status != 0) {
+            return limit_status;
+        }
 
         line = FormatLine(line);
         if (line.empty()) {
             continue;
         }
+        if (section_ended && !IsOrigLine(line)) {
+            continue;
+        }
 
-        auto command = LineLabelSplit(line, current_address);
+        std::string command;
+        {
+            AllocPhaseScope split_phase(PHASE_LABEL_SPLIT);
+            command = LineLabelSplit(line, current_address);
+        }
         if (command.empty()) {
             continue;
         }
@@ -114,6 +216,8 @@ int assembler::firstPass(std::string &input_filename) {
                 return -2;
             }
             current_address = orig_address;  //代码起始地址赋值
+            sections.push_back({(unsigned)orig_address, commands.size()});
+            section_ended = false;
             continue;
         }
 
@@ -122,8 +226,9 @@ int assembler::firstPass(std::string &input_filename) {
             return -3;
         }
 
-        if (first_token == ".END") {  //读取到.END即终止汇编过程
-            break;
+        if (first_token == ".END") {  //读取到.END即结束当前段
+            section_ended = true;
+            continue;
         }
         //逐一保存指令及对应内存地址
         // For LC3 Operation
@@ -132,45 +237,68 @@ int assembler::firstPass(std::string &input_filename) {
             commands.push_back(
                 {current_address, command, CommandType::OPERATION});  
             current_address += 1;
+            output_words += 1;
             continue;
         }
 
         // For Pseudo code
-        commands.push_back({current_address, command, CommandType::PSEUDO});
         auto operand = command.substr(first_whitespace_position + 1);
+        if (first_token == ".EXTERNAL") {
+            externals.insert(operand);
+            continue;
+        }
+        if (first_token == ".GLOBAL") {
+            globals.push_back(operand);
+            continue;
+        }
+        commands.push_back({current_address, command, CommandType::PSEUDO});
+        auto operand_status = PseudoOperandStatus(first_token, operand);
+        if (operand_status != 0) {
+            return operand_status;
+        }
         if (first_token == ".FILL") {
-            auto num_temp = RecognizeNumberValue(operand);
-            if (num_temp == std::numeric_limits<int>::max()) {
-                // @ Error Invalid Number input @ FILL
-                return -4;
-            }
-            if (num_temp > 65535 || num_temp < -65536) {
-                // @ Error Too large or too small value  @ FILL
-                return -5;
-            }
             current_address += 1;
+            output_words += 1;
         }
         if (first_token == ".BLKW") {
             // modify current_address
             // TO BE DONE
             auto num_temp = RecognizeNumberValue(operand);
-            if (num_temp == std::numeric_limits<int>::max()) {
-                // @ Error Invalid Number input @ BLKW
-                return -6;
-            }
-            if (num_temp > 100 || num_temp <= 0) {
-                // @ Error Too large or too small value  @ BLKW
-                return -7;
-            }
-            current_address += (num_temp-1);
+            current_address += num_temp;
+            output_words += num_temp;
         }
         if (first_token == ".STRINGZ") {
             // modify current_address
             // TO BE DONE
-            current_address += (int)operand.length();
+            current_address += StringzWordCount(operand);
+            output_words += StringzWordCount(operand);
         }
     }
     // OK flag
+    return OutputWordsStatus(output_words);
+}
+
+// Deadline and cancellation of the job; cheap, but called only every
+// kLimitCheckInterval lines
+int assembler::LimitStatus() const {
+    const auto &limits = options.limits;
+    if (limits.cancelled && *limits.cancelled) {
+        // @ Error job cancelled
+        return -43;
+    }
+    if (limits.deadline != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() > limits.deadline) {
+        // @ Error job ran past its deadline
+        return -40;
+    }
+    return 0;
+}
+
+int assembler::OutputWordsStatus(size_t word_count) const {
+    if (options.limits.max_output_words != 0 && word_count > options.limits.max_output_words) {
+        // @ Error output larger than the job allows
+        return -42;
+    }
     return 0;
 }
 
@@ -184,8 +312,6 @@ std::string assembler::TranslatePseudo(std::stringstream &command_stream) {
         std::string number_str;
         command_stream >> number_str;
         output_line = NumberToAssemble(RecognizeNumberValue(number_str));
-        if (gIsHexMode)
-            output_line = ConvertBin2Hex(output_line);
     } 
     else if (pseudo_opcode == ".BLKW") {
         // Fill 0 here
@@ -207,20 +333,11 @@ std::string assembler::TranslatePseudo(std::stringstream &command_stream) {
     else if (pseudo_opcode == ".STRINGZ") {
         // Fill string here
         // TO BE DONE
-        std::string char_str;
-        command_stream >> char_str;
-        int i = (int)char_str.length();
-        int j = 0;
-        while(i > 0)
-        {
-            if(char_str[j] == '"')
-            {
-                i--,j++;
-                continue;
-            }
-            output_line += NumberToAssemble(char_str[j]);
+        std::string operand;
+        std::getline(command_stream, operand);
+        for (char ch : StringzText(operand)) {
+            output_line += NumberToAssemble(ch);
             output_line += "\n";
-            i--,j++;
         }
         output_line += "0000000000000000";   //'\0'
     }
@@ -254,7 +371,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0001";
             if (operand_list_size != 3) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1]);
@@ -275,7 +393,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0101";
             if(operand_list_size != 3){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1]);
@@ -296,7 +415,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000111";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -305,7 +425,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000100";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -314,7 +435,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000010";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -323,7 +445,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000001";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -332,7 +455,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000110";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -341,7 +465,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000101";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -350,7 +475,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0000011";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],9);
             break;
@@ -359,7 +485,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0000111";
             if (operand_list_size != 1) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0], 9);
             break;
@@ -368,7 +495,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "1100000";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0]);
             output_line += "000000";
@@ -378,7 +506,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "01001";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address,operand_list[0],11);
             break;
@@ -387,7 +516,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             // TO BE DONE
             output_line += "0100000";
             if(operand_list_size != 1){
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += "000000";
@@ -398,7 +528,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0010";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1], 9);
@@ -409,7 +540,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1010";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1], 9);
@@ -420,7 +552,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0110";
             if (operand_list_size != 3) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1]);
@@ -432,7 +565,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1110";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1], 9);
@@ -443,7 +577,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1001";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1]);
@@ -454,7 +589,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1100000111000000";
             if (operand_list_size != 0) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             break;
         case 19:
@@ -463,7 +599,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1000000000000000";
             if (operand_list_size != 0) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             break;
         case 20:
@@ -471,7 +608,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0011";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1], 9);
@@ -482,7 +620,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "1011";
             if (operand_list_size != 2) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1], 9);
@@ -493,7 +632,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "0111";
             if (operand_list_size != 3) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0]);
             output_line += TranslateOprand(current_address, operand_list[1]);
@@ -505,7 +645,8 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
             output_line += "11110000";
             if (operand_list_size != 1) {
                 // @ Error operand numbers
-                exit(-30);
+                translate_status = -30;
+                return output_line;
             }
             output_line += TranslateOprand(current_address, operand_list[0],8);
             break;
@@ -517,41 +658,510 @@ std::string assembler::TranslateCommand(std::stringstream &command_stream, unsig
         }
     }
 
-    if (gIsHexMode)
-        output_line = ConvertBin2Hex(output_line);
-
     return output_line;
 }
 
+namespace {
+
+// Spell `words` with a text emitter, one line per word
+template <class Emitter>
+std::string FormatText(const std::vector<LC3Word> &words) {
+    std::string text(Emitter::Size(words.size()), '\0');
+    for (size_t i = 0; i < words.size(); ++i) {
+        Emitter::Put(Emitter::At(&text[0], i, 0), words[i]);
+    }
+    return text;
+}
+
+} // namespace
+
+// Text of one command as it appears in a text output file (hex with
+// FORMAT_HEX_TEXT, binary otherwise), including the final newline
+std::string assembler::TranslateLine(const CommandView &command) {
+    std::vector<LC3Word> words;
+    TranslateWords(command, words);
+    return options.format == FORMAT_HEX_TEXT ? FormatText<HexTextEmitter>(words)
+                                            : FormatText<BinaryTextEmitter>(words);
+}
+
+// Normalized text of an instruction for the encode cache: the blank
+// separated tokens joined by single blanks. False when an operand is a label
+// of this program, whose offset depends on the address.
+bool assembler::CacheKey(const char *text, size_t length, std::string &key) const {
+    key.clear();
+    const char *cursor = text;
+    const char *end = text + length;
+    while (true) {
+        while (cursor != end && std::isspace((unsigned char)*cursor)) {
+            ++cursor;
+        }
+        if (cursor == end) {
+            return true;
+        }
+        const char *token = cursor;
+        while (cursor != end && !std::isspace((unsigned char)*cursor)) {
+            ++cursor;
+        }
+        if (!key.empty()) {
+            std::string operand(token, cursor);
+            if (label_map.GetAddress(operand) != -1 || externals.count(operand) != 0) {
+                key.clear();
+                return false;
+            }
+            key += ' ';
+        }
+        key.append(token, cursor);
+    }
+}
+
+void assembler::TranslateWords(const CommandView &command, std::vector<LC3Word> &words) {
+    // Label-free instructions come from (and go to) the shared encode cache
+    std::string cache_key;
+    if (command.type == CommandType::OPERATION && options.encode_cache != nullptr &&
+        CacheKey(command.text, command.length, cache_key)) {
+        LC3Word word;
+        if (options.encode_cache->Lookup(cache_key, word)) {
+            words.push_back(word);
+            return;
+        }
+    }
+    const size_t first_word = words.size();
+    auto command_stream = std::stringstream(std::string(command.text, command.length));
+    std::string output_line = command.type == CommandType::PSEUDO
+                                  ? TranslatePseudo(command_stream)
+                                  : TranslateCommand(command_stream, command.address);
+    // one 16 bit binary string per line
+    for (size_t pos = 0; pos + kLC3LineLength <= output_line.size(); pos += kLC3LineLength + 1) {
+        LC3Word word = 0;
+        for (int bit = 0; bit < kLC3LineLength; ++bit) {
+            word = (LC3Word)((word << 1) | (output_line[pos + bit] == '1'));
+        }
+        words.push_back(word);
+    }
+    if (!cache_key.empty() && translate_status == 0 && words.size() == first_word + 1) {
+        options.encode_cache->Insert(cache_key, words.back());
+    }
+}
+
+// Words a command occupies, known right after the first pass
+size_t assembler::CommandWordCount(const CommandView &command) {
+    if (command.type == CommandType::OPERATION) {
+        return 1;
+    }
+    std::string content(command.text, command.length);
+    auto operand = content.substr(content.find(' ') + 1);
+    if (content.compare(0, 5, ".FILL") == 0) {
+        return 1;
+    }
+    if (content.compare(0, 5, ".BLKW") == 0) {
+        return RecognizeNumberValue(operand);
+    }
+    if (content.compare(0, 8, ".STRINGZ") == 0) {
+        return StringzWordCount(operand);
+    }
+    return 0; // unknown pseudo, translates to nothing
+}
+
+CommandView assembler::Command(size_t index) const {
+    if (ir_lines != nullptr) {
+        const IRLine &line = ir_lines[index];
+        return {line.address, ir_text + line.text_offset, line.text_length, (CommandType)line.type};
+    }
+    const auto &command = commands[index];
+    return {std::get<0>(command), std::get<1>(command).data(), std::get<1>(command).size(),
+            std::get<2>(command)};
+}
+
+std::vector<size_t> assembler::WordIndex() const {
+    const size_t command_count = CommandCount();
+    std::vector<size_t> word_index(command_count + 1, 0);
+    for (size_t i = 0; i < command_count; ++i) {
+        word_index[i + 1] = word_index[i] + CommandWordCount(Command(i));
+    }
+    return word_index;
+}
+
+// Origin of the output: that of the first section holding any words (of
+// the first section when none does). A format that stores the words in
+// sequence (text, .obj) cannot express a gap or a jump back between
+// sections, so with `contiguous` every later section must start right
+// where the one before it ended. A format that stores them by address
+// (memory image) needs sections that fit into memory and do not overlap,
+// the same rule the linker applies.
+int assembler::OutputOrigin(const std::vector<size_t> &word_index, bool contiguous,
+                            unsigned &origin) const {
+    origin = sections.empty() ? 0 : sections.front().origin;
+    bool found = false;
+    unsigned next_address = 0;
+    std::vector<std::pair<unsigned, size_t>> ranges; // (起始地址, 字数)
+    for (size_t k = 0; k < sections.size(); ++k) {
+        size_t last = k + 1 < sections.size() ? sections[k + 1].first_command : CommandCount();
+        size_t word_count = word_index[last] - word_index[sections[k].first_command];
+        if (word_count == 0) {
+            continue;
+        }
+        if (!found) {
+            origin = sections[k].origin;
+            found = true;
+        } else if (contiguous && sections[k].origin != next_address) {
+            // @ Error sections are not contiguous, the format has no addresses
+            return -23;
+        }
+        next_address = sections[k].origin + word_count;
+        ranges.push_back({sections[k].origin, word_count});
+    }
+    if (contiguous) {
+        return 0;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        size_t end = ranges[i].first + ranges[i].second;
+        if (end > kLC3MemoryWords) {
+            // @ Error program runs past the end of memory
+            return -22;
+        }
+        if (i + 1 < ranges.size() && end > ranges[i + 1].first) {
+            // @ Error overlapping sections
+            return -60;
+        }
+    }
+    return 0;
+}
+
+// Translate commands [first, last) and let `Emitter` place their words in the
+// output buffer `base`
+template <class Emitter>
+int assembler::EmitCommands(char *base, const std::vector<size_t> &word_index, size_t first,
+                            size_t last) {
+    std::vector<LC3Word> words;
+    for (size_t i = first; i < last; ++i) {
+        if ((i - first) % kLimitCheckInterval == kLimitCheckInterval - 1) {
+            auto limit_status = LimitStatus();
+            if (limit_status != 0) {
+                return limit_status;
+            }
+        }
+        const CommandView command = Command(i);
+        words.clear();
+        {
+            AllocPhaseScope pass_phase(PHASE_PASS2);
+            TranslateWords(command, words);
+        }
+        if (translate_status != 0) {
+            // @ Error in an instruction (set here or by another thread)
+            return translate_status;
+        }
+        if (words.size() != word_index[i + 1] - word_index[i]) {
+            // @ Error command does not fit its precomputed slot
+            return -21;
+        }
+        unsigned address = command.address;
+        if (Emitter::kByAddress && address + words.size() > kLC3MemoryWords) {
+            // @ Error program runs past the end of memory
+            return -22;
+        }
+        for (size_t w = 0; w < words.size(); ++w) {
+            Emitter::Put(Emitter::At(base, word_index[i] + w, address + w), words[w]);
+        }
+    }
+    return 0;
+}
+
+template <class Emitter>
 int assembler::secondPass(std::string &output_filename) {
     // Scan #2:
     // Translate
-    std::ofstream output_file;
-    // Create the output file
-    output_file.open(output_filename);
-    if (!output_file) {
+    auto word_index = WordIndex();
+    auto limit_status = OutputWordsStatus(word_index.back());
+    if (limit_status != 0) {
+        return limit_status;
+    }
+    unsigned origin = 0;
+    auto origin_status = OutputOrigin(word_index, !Emitter::kByAddress, origin);
+    if (origin_status != 0) {
+        return origin_status;
+    }
+    OutputBuffer output(Emitter::Size(word_index.back()));
+    if (!output.ok()) {
+        // @ Error at output file
+        return -20;
+    }
+    Emitter::Begin(output.data(), origin);
+    auto status = EmitCommands<Emitter>(output.data(), word_index, 0, CommandCount());
+    if (status != 0) {
+        return status;
+    }
+
+    // Write the output file, or hand the pages to a stdout pipe
+    AllocPhaseScope write_phase(PHASE_WRITE);
+    return WriteOutput(output_filename, output);
+}
+
+namespace {
+
+// Create `filename` with exactly `size` (> 0) bytes and map it for writing
+char *MapOutputFile(const std::string &filename, size_t size) {
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return map == MAP_FAILED ? nullptr : static_cast<char *>(map);
+}
+
+int UnmapOutputFile(char *map, size_t size) {
+    int status = msync(map, size, MS_ASYNC);
+    return munmap(map, size) == 0 && status == 0 ? 0 : -20;
+}
+
+unsigned OutputThreadCount(unsigned output_threads) {
+    return output_threads != 0 ? output_threads : DefaultThreadCount();
+}
+
+} // namespace
+
+// Scan #2 without an ordered merge: every command's place in the output
+// follows from its word count, so threads translate disjoint command ranges
+// and put their words straight into the preallocated, mapped file.
+template <class Emitter>
+int assembler::secondPassMapped(std::string &output_filename) {
+    auto word_index = WordIndex(); // 每条指令第一个字的序号
+    auto limit_status = OutputWordsStatus(word_index.back());
+    if (limit_status != 0) {
+        return limit_status;
+    }
+    unsigned origin = 0;
+    auto origin_status = OutputOrigin(word_index, !Emitter::kByAddress, origin);
+    if (origin_status != 0) {
+        return origin_status;
+    }
+    const size_t output_size = Emitter::Size(word_index.back());
+    if (output_size == 0) {
+        // nothing to map, but the (empty) output file must still exist
+        return std::ofstream(output_filename) ? 0 : -20;
+    }
+
+    char *map;
+    {
+        AllocPhaseScope write_phase(PHASE_WRITE);
+        map = MapOutputFile(output_filename, output_size);
+    }
+    if (map == nullptr) {
+        // @ Error at output file
+        return -20;
+    }
+    Emitter::Begin(map, origin);
+    int status;
+    try {
+        status = EmitParallel<Emitter>(map, word_index);
+    } catch (...) {
+        UnmapOutputFile(map, output_size);
+        unlink(output_filename.c_str());
+        throw;
+    }
+
+    auto unmap_status = UnmapOutputFile(map, output_size);
+    if (status != 0 || unmap_status != 0) {
+        // like the serial pass, leave no output behind on an error
+        unlink(output_filename.c_str());
+    }
+    return status != 0 ? status : unmap_status;
+}
+
+// EmitCommands() over all commands on the output threads, in a few chunks
+// per thread of roughly equal word count
+template <class Emitter>
+int assembler::EmitParallel(char *base, const std::vector<size_t> &word_index) {
+    const unsigned thread_count = OutputThreadCount(options.output_threads);
+    const size_t chunk_count = std::min<size_t>(CommandCount(), thread_count * 4);
+    std::vector<size_t> chunk_begin(chunk_count + 1, CommandCount());
+    for (size_t c = 0; c < chunk_count; ++c) {
+        chunk_begin[c] = std::lower_bound(word_index.begin(), word_index.end() - 1,
+                                          word_index.back() * c / chunk_count) -
+                         word_index.begin();
+    }
+
+    std::atomic<int> status(0);
+    ParallelFor(chunk_count, thread_count, [&](size_t c) {
+        if (status != 0) {
+            return;
+        }
+        auto chunk_status = EmitCommands<Emitter>(base, word_index, chunk_begin[c], chunk_begin[c + 1]);
+        if (chunk_status != 0) {
+            status = chunk_status;
+        }
+    });
+    return status;
+}
+
+namespace {
+
+// Native words in memory: the one encoding every writer of emitAll() reads
+struct WordEmitter
+{
+    static const bool kByAddress = false;
+    static const size_t kWordBytes = sizeof(LC3Word);
+
+    static char *At(char *base, size_t index, unsigned) { return base + index * kWordBytes; }
+    static void Put(char *out, LC3Word word) { std::memcpy(out, &word, sizeof(word)); }
+};
+
+} // namespace
+
+// Write encoded `words` (command i owns [word_index[i], word_index[i + 1]))
+// in the layout of `Emitter`
+template <class Emitter>
+int assembler::writeEncoded(const std::string &filename, const std::vector<LC3Word> &words,
+                            const std::vector<size_t> &word_index) const {
+    unsigned origin = 0;
+    auto origin_status = OutputOrigin(word_index, !Emitter::kByAddress, origin);
+    if (origin_status != 0) {
+        return origin_status;
+    }
+    OutputBuffer output(Emitter::Size(words.size()));
+    if (!output.ok()) {
         // @ Error at output file
         return -20;
     }
+    Emitter::Begin(output.data(), origin);
+    for (size_t i = 0; i < CommandCount(); ++i) {
+        unsigned address = Command(i).address;
+        if (Emitter::kByAddress && address + (word_index[i + 1] - word_index[i]) > kLC3MemoryWords) {
+            // @ Error program runs past the end of memory
+            return -22;
+        }
+        for (size_t w = word_index[i]; w < word_index[i + 1]; ++w) {
+            Emitter::Put(Emitter::At(output.data(), w, address++), words[w]);
+        }
+    }
+    return WriteOutput(filename, output);
+}
 
-    for (const auto &command : commands) {  //从逐行保存的指令中依次读取内存地址、指令内容、指令类型
-        const unsigned address = std::get<0>(command);
-        const std::string command_content = std::get<1>(command);
-        const CommandType command_type = std::get<2>(command);
-        auto command_stream = std::stringstream(command_content);
+// Listing: one line per word with its address, hex and binary spelling, the
+// label at that address and the (formatted) source of the command
+int assembler::writeListing(const std::string &filename, const std::vector<LC3Word> &words,
+                            const std::vector<size_t> &word_index) const {
+    std::map<unsigned, std::string> labels; // 每个地址取字典序最小的标签
+    for (const auto &label : label_map.GetLabels()) {
+        auto item = labels.find(label.second);
+        if (item == labels.end() || label.first < item->second) {
+            labels[label.second] = label.first;
+        }
+    }
 
-        if (command_type == CommandType::PSEUDO) {
-            // Pseudo
-            output_file << TranslatePseudo(command_stream) << std::endl;
-        } else {
-            // LC3 command
-            output_file << TranslateCommand(command_stream, address) << std::endl;
+    std::string text = ";  addr  hex   binary            label             source\n";
+    char line[64];
+    for (size_t i = 0; i < CommandCount(); ++i) {
+        const CommandView command = Command(i);
+        unsigned address = command.address;
+        for (size_t w = word_index[i]; w < word_index[i + 1]; ++w, ++address) {
+            char binary[BinaryTextEmitter::kWordBytes];
+            BinaryTextEmitter::Put(binary, words[w]);
+            std::snprintf(line, sizeof(line), "  x%04X  %04X  %.16s  ", address & 0xFFFF,
+                          (unsigned)words[w], binary);
+            text += line;
+            auto label = labels.find(address);
+            size_t name_length = 0;
+            if (label != labels.end()) {
+                text += label->second;
+                name_length = label->second.size();
+            }
+            if (name_length < 16) {
+                text.append(16 - name_length, ' ');
+            }
+            if (w == word_index[i]) {
+                text += "  ";
+                text.append(command.text, command.length);
+            }
+            while (!text.empty() && text.back() == ' ') {
+                text.pop_back();
+            }
+            text += '\n';
         }
     }
 
-    // Close the output file
-    output_file.close();
-    // OK flag
+    return WriteOutput(filename, text);
+}
+
+// Several outputs from one encoding: pass 2 translates every command once
+// into a word table, then the requested writers run side by side on it
+int assembler::emitAll(const OutputSet &outputs) {
+    auto word_index = WordIndex();
+    auto limit_status = OutputWordsStatus(word_index.back());
+    if (limit_status != 0) {
+        return limit_status;
+    }
+    // Every requested format must be able to hold the program before any
+    // file is written, so a run gives all of its outputs or none
+    unsigned origin = 0;
+    if (!outputs.binary_text.empty() || !outputs.hex_text.empty() || !outputs.binary_object.empty()) {
+        auto layout_status = OutputOrigin(word_index, true, origin);
+        if (layout_status != 0) {
+            return layout_status;
+        }
+    }
+    if (!outputs.memory_image.empty()) {
+        auto layout_status = OutputOrigin(word_index, false, origin);
+        if (layout_status != 0) {
+            return layout_status;
+        }
+    }
+    std::vector<LC3Word> words(word_index.back());
+    translate_status = 0;
+    auto status = EmitParallel<WordEmitter>(reinterpret_cast<char *>(words.data()), word_index);
+    if (status != 0) {
+        return status;
+    }
+
+    std::vector<std::pair<std::string, std::function<int()>>> writers; // (路径, 写出函数)
+    if (!outputs.binary_text.empty()) {
+        writers.push_back({outputs.binary_text, [&]() {
+            return writeEncoded<BinaryTextEmitter>(outputs.binary_text, words, word_index);
+        }});
+    }
+    if (!outputs.hex_text.empty()) {
+        writers.push_back({outputs.hex_text, [&]() {
+            return writeEncoded<HexTextEmitter>(outputs.hex_text, words, word_index);
+        }});
+    }
+    if (!outputs.binary_object.empty()) {
+        writers.push_back({outputs.binary_object, [&]() {
+            return writeEncoded<BinaryObjectEmitter>(outputs.binary_object, words, word_index);
+        }});
+    }
+    if (!outputs.memory_image.empty()) {
+        writers.push_back({outputs.memory_image, [&]() {
+            return writeEncoded<MemoryImageEmitter>(outputs.memory_image, words, word_index);
+        }});
+    }
+    if (!outputs.symbols.empty()) {
+        writers.push_back({outputs.symbols, [&]() { return writeSymbols(outputs.symbols); }});
+    }
+    if (!outputs.listing.empty()) {
+        writers.push_back({outputs.listing, [&]() { return writeListing(outputs.listing, words, word_index); }});
+    }
+
+    std::vector<int> statuses(writers.size(), 0);
+    ParallelFor(writers.size(), writers.size(), [&](size_t i) {
+        AllocPhaseScope write_phase(PHASE_WRITE);
+        statuses[i] = writers[i].second();
+    });
+    for (auto writer_status : statuses) {
+        if (writer_status != 0) {
+            // an output error in one writer: take back the files of the others
+            for (size_t i = 0; i < writers.size(); ++i) {
+                if (statuses[i] == 0 && !IsStdioFilename(writers[i].first)) {
+                    unlink(writers[i].first.c_str());
+                }
+            }
+            return writer_status;
+        }
+    }
     return 0;
 }
 
@@ -561,10 +1171,143 @@ int assembler::assemble(std::string &input_filename, std::string &output_filenam
     if (first_scan_status != 0) {  
         return first_scan_status;
     }
-    auto second_scan_status = secondPass(output_filename);
+    return emit(output_filename);
+}
+
+int assembler::parse(std::string &input_filename) {
+    return firstPass(input_filename);
+}
+
+// Pass 2 over the commands of parse() or loadIR()
+int assembler::emit(std::string &output_filename) {
+    // The output format is picked here once; each emitter gets its own pass 2
+    // 内存映像总是整块映射输出; stdout无法映射, 只能单线程输出
+    bool mapped = (options.mapped || options.format == FORMAT_MEMORY_IMAGE) &&
+                  !IsStdioFilename(output_filename);
+    int second_scan_status;
+    translate_status = 0;
+    switch (options.format) {
+    case FORMAT_HEX_TEXT:
+        second_scan_status = mapped ? secondPassMapped<HexTextEmitter>(output_filename)
+                                    : secondPass<HexTextEmitter>(output_filename);
+        break;
+    case FORMAT_BINARY_OBJECT:
+        second_scan_status = mapped ? secondPassMapped<BinaryObjectEmitter>(output_filename)
+                                    : secondPass<BinaryObjectEmitter>(output_filename);
+        break;
+    case FORMAT_MEMORY_IMAGE:
+        second_scan_status = mapped ? secondPassMapped<MemoryImageEmitter>(output_filename)
+                                    : secondPass<MemoryImageEmitter>(output_filename);
+        break;
+    default:
+        second_scan_status = mapped ? secondPassMapped<BinaryTextEmitter>(output_filename)
+                                    : secondPass<BinaryTextEmitter>(output_filename);
+        break;
+    }
     if (second_scan_status != 0) {
         return second_scan_status;
     }
     // OK flag
     return 0;
 }
+
+// 汇编为可重定位目标文件: 各段独立保存, 跨段及外部标签引用留给链接器解析
+int assembler::assembleObject(std::string &input_filename, std::string &output_filename) {
+    auto first_scan_status = firstPass(input_filename);
+    if (first_scan_status != 0) {
+        return first_scan_status;
+    }
+    return emitObject(output_filename);
+}
+
+int assembler::emitObject(std::string &output_filename) {
+    ObjectModule module;
+    for (const auto &name : globals) {
+        auto label = label_sections.find(name);
+        if (label == label_sections.end()) {
+            // @ Error .GLOBAL label is not defined in this module
+            return -8;
+        }
+    }
+    for (const auto &label : label_map.GetLabels()) {
+        size_t section = label_sections.at(label.first);
+        if (section >= sections.size()) {
+            continue; // label before the first .ORIG
+        }
+        bool exported = std::find(globals.begin(), globals.end(), label.first) != globals.end();
+        module.symbols.push_back(
+            {label.first, section, label.second - sections[section].origin, exported});
+    }
+    std::sort(module.symbols.begin(), module.symbols.end(),
+              [](const ObjectSymbol &a, const ObjectSymbol &b) {
+                  return std::tie(a.section, a.offset, a.name) < std::tie(b.section, b.offset, b.name);
+              });
+    module.imports.assign(externals.begin(), externals.end());
+
+    object = &module;
+    auto section_status = TranslateSections(module.sections);
+    object = nullptr;
+    if (section_status != 0) {
+        return section_status;
+    }
+
+    return WriteObjectModule(module, output_filename);
+}
+
+int assembler::TranslateSections(std::vector<ObjectSection> &output_sections) {
+    translate_status = 0;
+    auto limit_status = OutputWordsStatus(WordIndex().back());
+    if (limit_status != 0) {
+        return limit_status;
+    }
+    for (translate_section = 0; translate_section < sections.size(); ++translate_section) {
+        size_t first = sections[translate_section].first_command;
+        size_t last = translate_section + 1 < sections.size()
+                          ? sections[translate_section + 1].first_command
+                          : CommandCount();
+        output_sections.push_back({sections[translate_section].origin, {}});
+        for (size_t i = first; i < last; ++i) {
+            if (i % kLimitCheckInterval == kLimitCheckInterval - 1) {
+                limit_status = LimitStatus();
+                if (limit_status != 0) {
+                    return limit_status;
+                }
+            }
+            TranslateWords(Command(i), output_sections.back().words);
+        }
+    }
+    return translate_status;
+}
+
+// 汇编为各段机器字而不写出文件(供反汇编往返校验使用)
+int assembler::encodeSections(std::string &input_filename, std::vector<ObjectSection> &output_sections) {
+    auto first_scan_status = firstPass(input_filename);
+    if (first_scan_status != 0) {
+        return first_scan_status;
+    }
+    return TranslateSections(output_sections);
+}
+
+// Write the symbol table in the usual LC-3 .sym layout, sorted by address
+int assembler::writeSymbols(const std::string &sym_filename) const {
+    std::vector<std::pair<unsigned, std::string>> symbols;
+    for (const auto &label : label_map.GetLabels()) {
+        if (label.second < kLC3MemoryWords) { // skip labels before the first .ORIG
+            symbols.push_back({label.second, label.first});
+        }
+    }
+    std::sort(symbols.begin(), symbols.end());
+
+    std::ostringstream sym_file;
+    sym_file << "// Symbol table" << std::endl;
+    sym_file << "// Scope level 0:" << std::endl;
+    sym_file << "//\tSymbol Name       Page Address" << std::endl;
+    sym_file << "//\t----------------  ------------" << std::endl;
+    for (const auto &symbol : symbols) {
+        sym_file << "//\t" << std::left << std::setw(16) << symbol.second << "  " << std::right
+                 << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << symbol.first
+                 << std::setfill(' ') << std::dec << std::endl;
+    }
+    sym_file << std::endl;
+    return WriteOutput(sym_filename, sym_file.str()); // 文件名为"-"时写到stdout
+}
@@ -6,22 +6,36 @@
  * @Description  : header file for small assembler
  */
 
+#ifndef ASSEMBLER_ASSEMBLER_H
+#define ASSEMBLER_ASSEMBLER_H
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <string>
 #include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <bits/stdc++.h>
+#include "emitter.h"
+#include "encode_cache.h"
+#include "ir.h"
+#include "object.h"
 using namespace std; // 使用标准命名空间
 
 const int kLC3LineLength = 16; // LC3指令长度16位
-extern bool gIsErrorLogMode;
-extern bool gIsHexMode;
+const unsigned kLC3MemoryWords = 65536; // LC3地址空间字数
 
 const std::vector<std::string> kLC3Pseudos({
     // LC3伪操作向量集
@@ -30,6 +44,8 @@ const std::vector<std::string> kLC3Pseudos({
     ".STRINGZ",
     ".FILL",
     ".BLKW",
+    ".EXTERNAL", // 声明外部模块定义的标签(仅用于可重定位目标文件)
+    ".GLOBAL",   // 导出本模块定义的标签
 });
 
 const std::vector<std::string> kLC3Commands({
@@ -83,15 +99,42 @@ enum CommandType
     PSEUDO
 }; // 枚举指令类型
 
-static inline void SetErrorLogMode(bool error)
+// One pass 1 command as pass 2 reads it; the text is not owned (it lives in
+// `commands` or in a mapped IR file)
+struct CommandView
 {
-    gIsErrorLogMode = error;
-}
+    unsigned address;
+    const char *text;
+    size_t length;
+    CommandType type;
+};
 
-static inline void SetHexMode(bool hex)
+// Budget of one assembly job, checked at cheap points in both passes; each
+// limit that is hit ends the job with its own status
+struct AssemblerLimits
 {
-    gIsHexMode = hex;
-}
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max(); // 截止时间 (-40)
+    size_t max_input_bytes = 0;                      // 最大输入字节数, 0表示不限 (-41)
+    size_t max_output_words = 0;                     // 最多输出字数, 0表示不限 (-42)
+    std::shared_ptr<std::atomic<bool>> cancelled;    // 取消标志, 置为true即停止 (-43)
+};
+
+const size_t kLimitCheckInterval = 64; // 每处理64行检查一次时钟和取消标志
+
+// Configuration of one assembler instance. Each instance may run on its own
+// thread with its own options; the only state they share is, on purpose,
+// the encode cache (DefaultEncodeCache() unless set), which locks itself.
+// Setting `encode_cache` to nullptr turns the cache off.
+struct AssemblerOptions
+{
+    bool error_log = false;                   // 纠错调试模式
+    OutputFormat format = FORMAT_BINARY_TEXT; // 输出格式
+    bool mapped = false;                      // 多线程映射输出模式
+    unsigned output_threads = 0;              // 输出线程数, 0表示使用全部核心
+    EncodeCache *encode_cache = &DefaultEncodeCache(); // 共享的指令编码缓存, 空表示不缓存
+    AssemblerLimits limits;
+};
 
 // A wrapper class for std::unorderd_map in order to map label to its address (标签地址映射表)
 class LabelMapType
@@ -101,10 +144,13 @@ private:
 
 public:
     void AddLabel(const std::string &str, unsigned address);
+    void SetAddress(const std::string &str, unsigned address);
+    void Clear();
     int GetAddress(const std::string &str) const;
+    const std::unordered_map<std::string, unsigned> &GetLabels() const { return labels_; }
 };
 
-static inline int IsLC3Pseudo(const std::string &str)
+inline int IsLC3Pseudo(const std::string &str)
 {
     int index = 0;
     for (const auto &command : kLC3Pseudos)
@@ -118,7 +164,7 @@ static inline int IsLC3Pseudo(const std::string &str)
     return -1;
 }
 
-static inline int IsLC3Command(const std::string &str)
+inline int IsLC3Command(const std::string &str)
 {
     int index = 0;
     for (const auto &command : kLC3Commands)
@@ -132,7 +178,7 @@ static inline int IsLC3Command(const std::string &str)
     return -1;
 }
 
-static inline int IsLC3TrapRoutine(const std::string &str)
+inline int IsLC3TrapRoutine(const std::string &str)
 {
     int index = 0;
     for (const auto &trap : kLC3TrapRoutine)
@@ -146,7 +192,7 @@ static inline int IsLC3TrapRoutine(const std::string &str)
     return -1;
 }
 
-static inline int CharToDec(const char &ch)
+inline int CharToDec(const char &ch)
 { // 16进制字符转换为十进制整数
     if (ch >= '0' && ch <= '9')
     {
@@ -159,7 +205,7 @@ static inline int CharToDec(const char &ch)
     return -1;
 }
 
-static inline char DecToChar(const int &num)
+inline char DecToChar(const int &num)
 { // 十进制整数转换为16进制字符
     if (num <= 9)
     {
@@ -169,7 +215,7 @@ static inline char DecToChar(const int &num)
 }
 
 // trim string from both left & right
-static inline std::string &Trim(std::string &s)
+inline std::string &Trim(std::string &s)
 {
     // TO BE DONE
     s.erase(s.find_last_not_of(" \t\n\r\f\v") + 1);
@@ -184,7 +230,7 @@ static inline std::string &Trim(std::string &s)
 // 4. replace all "\t\n\r\f\v" with whitespace
 // 5. remove the leading and trailing whitespace chars
 // Note: please implement function Trim first
-static std::string FormatLine(std::string &line)
+inline std::string FormatLine(std::string &line)
 {
     // TO BE DONE
     string fline = Trim(line); // trim the input line
@@ -200,34 +246,101 @@ static std::string FormatLine(std::string &line)
     return fline;
 }
 
-static int RecognizeNumberValue(const std::string &str)
+inline int RecognizeNumberValue(const std::string &str)
 {
-    // Convert string `str` into a number and return it
-    // TO BE DONE
+    // Convert string `str` into a number and return it; a string that is not
+    // a number (e.g. an undefined label) gives std::numeric_limits<int>::max()
     std::string s = str;
     s = Trim(s);
+    if (s.empty())
+    {
+        return 0;
+    }
+    int base = 10;
+    size_t start = 0;
     if (s[0] == 'x' || s[0] == 'X')
     {
-        s = s.substr(1);
-        int num = 0;
-        for (int i = 0; i < (int)s.length(); i++)
-            num = num * 16 + CharToDec(s[i]);
-        return num;
-        // return stoi(s,0,16);
+        base = 16;
+        start = 1;
     }
     else if (s[0] == '#')
     {
-        s = str.substr(1);
-        return stoi(s);
+        start = 1;
+    }
+    const char *begin = s.c_str() + start;
+    char *end = nullptr;
+    errno = 0;
+    long value = std::strtol(begin, &end, base);
+    if (end == begin || *end != '\0' || errno == ERANGE ||
+        value >= std::numeric_limits<int>::max() || value < std::numeric_limits<int>::min())
+    {
+        return std::numeric_limits<int>::max();
     }
-    else if (!s.empty())
+    return (int)value;
+}
+// Pass 1 checks of a .FILL or .BLKW operand: 0, or the status of the
+// problem (-4/-5 for .FILL, -6/-7 for .BLKW); other pseudos pass
+inline int PseudoOperandStatus(const std::string &pseudo, const std::string &operand)
+{
+    if (pseudo != ".FILL" && pseudo != ".BLKW")
     {
-        return stoi(s);
+        return 0;
     }
-    else
+    auto num_temp = RecognizeNumberValue(operand);
+    if (pseudo == ".FILL")
+    {
+        if (num_temp == std::numeric_limits<int>::max())
+        {
+            // @ Error Invalid Number input @ FILL
+            return -4;
+        }
+        if (num_temp > 65535 || num_temp < -65536)
+        {
+            // @ Error Too large or too small value  @ FILL
+            return -5;
+        }
         return 0;
+    }
+    if (num_temp == std::numeric_limits<int>::max())
+    {
+        // @ Error Invalid Number input @ BLKW
+        return -6;
+    }
+    if (num_temp > 100 || num_temp <= 0)
+    {
+        // @ Error Too large or too small value  @ BLKW
+        return -7;
+    }
+    return 0;
+}
+
+// Characters of a .STRINGZ operand: the text between its first and last
+// quote, so blanks around the quotes (and before a comment) are not part of
+// the string; an unquoted operand is taken as a whole
+inline std::string StringzText(const std::string &operand)
+{
+    auto first_quote = operand.find('"');
+    auto last_quote = operand.rfind('"');
+    if (first_quote == std::string::npos)
+    {
+        std::string text = operand;
+        return Trim(text);
+    }
+    if (last_quote == first_quote)
+    {
+        return operand.substr(first_quote + 1); // 缺少右引号
+    }
+    return operand.substr(first_quote + 1, last_quote - first_quote - 1);
+}
+
+// Number of words a .STRINGZ operand occupies: its characters plus the
+// terminating zero
+inline int StringzWordCount(const std::string &operand)
+{
+    return (int)StringzText(operand).size() + 1;
 }
-static std::string NumberToAssemble(const int &number)
+
+inline std::string NumberToAssemble(const int &number)
 {
     // Convert `number` into a 16 bit binary string
     // TO BE DONE
@@ -236,7 +349,7 @@ static std::string NumberToAssemble(const int &number)
     return str;
 }
 
-static std::string NumberToAssemble(const std::string &number)
+inline std::string NumberToAssemble(const std::string &number)
 {
     // Convert `number` into a 16 bit binary string
     // You might use `RecognizeNumberValue` in this function
@@ -247,7 +360,7 @@ static std::string NumberToAssemble(const std::string &number)
     return str;
 }
 
-static std::string ConvertBin2Hex(const std::string &bin)
+inline std::string ConvertBin2Hex(const std::string &bin)
 {
     // Convert the binary string `bin` into a hex string
     // TO BE DONE
@@ -265,13 +378,45 @@ static std::string ConvertBin2Hex(const std::string &bin)
     return hexstring;
 }
 
+// Outputs of one emitAll() run, each written when its path is not empty
+struct OutputSet
+{
+    std::string binary_text;   // 二进制文本
+    std::string hex_text;      // 十六进制文本
+    std::string binary_object; // LC3 .obj
+    std::string memory_image;  // 64K字内存映像
+    std::string symbols;       // .sym符号表
+    std::string listing;       // 列表文件
+};
+
 class assembler
 { // 定义类类型：assembler汇编器
+    friend class incremental_assembly;
+    friend struct AssemblerBenchAccess; // microbench.cpp
     using Commands = std::vector<std::tuple<unsigned, std::string, CommandType>>;
 
+    struct Section
+    {                          // 每个.ORIG开始一个段
+        unsigned origin;       // 段起始地址
+        size_t first_command;  // 段内第一条指令在commands中的下标
+    };
+
 private:
     LabelMapType label_map;
     Commands commands;
+    std::vector<Section> sections;
+    std::unordered_map<std::string, size_t> label_sections; // 标签所在段
+    std::unordered_set<std::string> externals;              // .EXTERNAL声明的标签
+    std::vector<std::string> globals;                       // .GLOBAL导出的标签
+    ObjectModule *object = nullptr; // 非空时按可重定位目标文件转译
+    size_t translate_section = 0;   // 正在转译的段
+    AssemblerOptions options;
+    std::atomic<int> translate_status{0}; // 转译错误码(-30/-31/-32), 供多线程的第二遍扫描共享
+    // A loaded IR file: pass 2 reads its lines in place instead of `commands`
+    InputBuffer ir_input;
+    const IRLine *ir_lines = nullptr;
+    size_t ir_line_count = 0;
+    const char *ir_text = nullptr;
 
     static std::string TranslatePseudo(std::stringstream &command_stream); // 转译伪指令
     std::string TranslateCommand(std::stringstream &command_stream,
@@ -279,9 +424,52 @@ private:
     std::string TranslateOprand(unsigned int current_address, std::string str,
                                 int opcode_length = 3);                       // 转译操作数
     std::string LineLabelSplit(const std::string &line, int current_address); // 分离标签
-    int firstPass(std::string &input_filename);
+    std::string TranslateLine(const CommandView &command);                       // 转译为输出文本(含换行)
+    void TranslateWords(const CommandView &command, std::vector<LC3Word> &words); // 转译为机器字
+    bool CacheKey(const char *text, size_t length, std::string &key) const;      // 编码缓存的键
+    static size_t CommandWordCount(const CommandView &command);                  // 指令占用字数
+    CommandView Command(size_t index) const;                                     // 第index条指令
+    size_t CommandCount() const { return ir_lines != nullptr ? ir_line_count : commands.size(); }
+    int TranslateSections(std::vector<ObjectSection> &output_sections);          // 按段转译全部指令
+    int firstPass(std::string &input_filename); // 文件名为"-"时读取stdin
+    int firstPass(std::istream &input_file);
+    std::vector<size_t> WordIndex() const;              // 每条指令第一个字的序号
+    int LimitStatus() const;                            // 是否超时或被取消
+    int OutputWordsStatus(size_t word_count) const;     // 是否超出输出字数限制
+    int OutputOrigin(const std::vector<size_t> &word_index, bool contiguous,
+                     unsigned &origin) const;           // 输出的起始地址, 顺序存放的格式要求各段相接
+    template <class Emitter>
+    int EmitCommands(char *base, const std::vector<size_t> &word_index, size_t first, size_t last);
+    template <class Emitter>
     int secondPass(std::string &output_filename);
+    template <class Emitter>
+    int secondPassMapped(std::string &output_filename); // 多线程直接写入映射的输出文件
+    template <class Emitter>
+    int EmitParallel(char *base, const std::vector<size_t> &word_index);
+    template <class Emitter>
+    int writeEncoded(const std::string &filename, const std::vector<LC3Word> &words,
+                     const std::vector<size_t> &word_index) const;
+    int writeListing(const std::string &filename, const std::vector<LC3Word> &words,
+                     const std::vector<size_t> &word_index) const;
 
 public:
+    explicit assembler(const AssemblerOptions &options = AssemblerOptions()) : options(options) {}
+    assembler(const assembler &) = delete;
+    assembler &operator=(const assembler &) = delete;
+
     int assemble(std::string &input_filename, std::string &output_filename); // 汇编主功能函数声明
+    int assembleObject(std::string &input_filename, std::string &output_filename); // 汇编为可重定位目标文件
+    // The two passes on their own, with the state between them saved to or
+    // loaded from an IR file (ir.cpp)
+    int parse(std::string &input_filename);                 // 仅第一遍扫描
+    int writeIR(const std::string &ir_filename) const;      // 保存第一遍扫描的结果
+    int loadIR(const std::string &ir_filename);             // 映射IR文件, 代替第一遍扫描
+    int emit(std::string &output_filename);                 // 仅第二遍扫描
+    int emitObject(std::string &output_filename);           // 第二遍扫描, 输出可重定位目标文件
+    int emitAll(const OutputSet &outputs);                  // 一次转译, 并行写出多种输出
+    int encodeSections(std::string &input_filename, std::vector<ObjectSection> &output_sections); // 汇编为各段机器字
+    int writeSymbols(const std::string &sym_filename) const; // 输出符号表
+    const LabelMapType &labels() const { return label_map; }
 };
+
+#endif
@@ -0,0 +1,438 @@
+/*
+ * @Description  : table-driven LC-3 disassembler for round-trip verification
+ */
+
+#include "disassembler.h"
+#include "assembler.h"
+#include <unistd.h>
+
+namespace {
+
+enum OperandFormat
+{
+    FORMAT_BR,       // nzp + PCoffset9
+    FORMAT_ALU,      // DR, SR1, SR2 | imm5 (ADD/AND)
+    FORMAT_PCREL,    // DR/SR, PCoffset9 (LD/LDI/LEA/ST/STI)
+    FORMAT_JSR,      // JSR PCoffset11 | JSRR BaseR
+    FORMAT_BASE,     // DR/SR, BaseR, offset6 (LDR/STR)
+    FORMAT_NOT,      // DR, SR
+    FORMAT_RTI,
+    FORMAT_JMP,      // JMP BaseR | RET
+    FORMAT_TRAP,     // trapvect8
+    FORMAT_RESERVED  // 1101, always .FILL
+};
+
+struct OpcodeEntry
+{
+    OperandFormat format;
+    int command; // kLC3Commands下标
+};
+
+// Indexed by the top four bits of the word
+const OpcodeEntry kOpcodeTable[16] = {
+    {FORMAT_BR, 2},        // 0000 BR
+    {FORMAT_ALU, 0},       // 0001 ADD
+    {FORMAT_PCREL, 13},    // 0010 LD
+    {FORMAT_PCREL, 20},    // 0011 ST
+    {FORMAT_JSR, 11},      // 0100 JSR/JSRR
+    {FORMAT_ALU, 1},       // 0101 AND
+    {FORMAT_BASE, 15},     // 0110 LDR
+    {FORMAT_BASE, 22},     // 0111 STR
+    {FORMAT_RTI, 19},      // 1000 RTI
+    {FORMAT_NOT, 17},      // 1001 NOT
+    {FORMAT_PCREL, 14},    // 1010 LDI
+    {FORMAT_PCREL, 21},    // 1011 STI
+    {FORMAT_JMP, 10},      // 1100 JMP/RET
+    {FORMAT_RESERVED, -1}, // 1101 reserved
+    {FORMAT_PCREL, 16},    // 1110 LEA
+    {FORMAT_TRAP, 23},     // 1111 TRAP
+};
+
+// Indexed by the n, z, p bits; -1 (never branches) is written as .FILL
+const int kBranchCommands[8] = {-1, 5, 4, 8, 3, 7, 6, 9};
+
+// Field extractors
+inline unsigned Dr(LC3Word word) { return (word >> 9) & 7; }
+inline unsigned Sr1(LC3Word word) { return (word >> 6) & 7; }
+inline unsigned Sr2(LC3Word word) { return word & 7; }
+inline int SignExtend(LC3Word word, int bits) {
+    int sign = 1 << (bits - 1);
+    int value = word & ((1 << bits) - 1);
+    return (value ^ sign) - sign;
+}
+
+const char kHexDigits[] = "0123456789ABCDEF";
+
+inline void AppendRegister(unsigned reg, std::string &out) {
+    out += 'R';
+    out += (char)('0' + reg);
+}
+
+inline void AppendDecimal(int value, std::string &out) {
+    char buffer[8];
+    int length = 0;
+    unsigned magnitude = value < 0 ? -value : value;
+    do {
+        buffer[length++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    out += '#';
+    if (value < 0) {
+        out += '-';
+    }
+    while (length > 0) {
+        out += buffer[--length];
+    }
+}
+
+inline void AppendHex(unsigned value, int digits, std::string &out) {
+    out += 'x';
+    for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+        out += kHexDigits[(value >> shift) & 0xF];
+    }
+}
+
+inline void AppendFill(LC3Word word, std::string &out) {
+    out += ".FILL ";
+    AppendHex(word, 4, out);
+}
+
+// Every line is parsed by its own length (16 binary or 4 hex digits). The
+// assembler writes one kind per file; files from older builds, whose hex
+// mode kept .BLKW and .STRINGZ in binary, still read back
+int ParseTextWords(const std::string &content, std::vector<LC3Word> &words) {
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == std::string::npos) {
+            end = content.size();
+        }
+        size_t length = end - pos;
+        if (length > 0 && content[end - 1] == '\r') {
+            --length;
+        }
+        if (length == (size_t)kLC3LineLength || length == (size_t)kLC3LineLength / 4) {
+            unsigned value = 0;
+            int base = length == (size_t)kLC3LineLength ? 2 : 16;
+            for (size_t i = pos; i < pos + length; ++i) {
+                int digit = CharToDec((char)std::toupper(content[i]));
+                if (digit < 0 || digit >= base) {
+                    // @ Error not assembler output
+                    return -81;
+                }
+                value = value * base + digit;
+            }
+            words.push_back((LC3Word)value);
+        } else if (length != 0) {
+            return -81;
+        }
+        pos = end + 1;
+    }
+    return 0;
+}
+
+bool IsTextOutput(const std::string &content) {
+    return content.find_first_not_of("0123456789ABCDEFabcdef\r\n") == std::string::npos;
+}
+
+} // namespace
+
+void disassembler::addSymbol(const std::string &name, unsigned address) {
+    labels.insert({address, name});
+}
+
+// Symbol lines look like "//\tNAME    3000"; header lines are skipped
+int disassembler::readSymbols(const std::string &sym_filename) {
+    std::ifstream sym_file(sym_filename);
+    if (!sym_file.is_open()) {
+        // @ Input file read error
+        return -1;
+    }
+    std::string line;
+    while (std::getline(sym_file, line)) {
+        if (line.compare(0, 2, "//") != 0) {
+            continue;
+        }
+        std::stringstream line_stream(line.substr(2));
+        std::string name, address;
+        if (!(line_stream >> name >> address) || name == "Symbol" || name == "Scope" ||
+            address.size() != 4 ||
+            address.find_first_not_of("0123456789ABCDEFabcdef") != std::string::npos) {
+            continue;
+        }
+        addSymbol(name, std::stoul(address, nullptr, 16));
+    }
+    return 0;
+}
+
+int disassembler::readSections(const std::string &filename, unsigned default_origin,
+                               std::vector<ObjectSection> &sections) {
+    std::ifstream input_file(filename, std::ios::binary);
+    if (!input_file.is_open()) {
+        // @ Input file read error
+        return -1;
+    }
+    std::stringstream buffer;
+    buffer << input_file.rdbuf();
+    const std::string content = buffer.str();
+    auto big_endian_word = [&content](size_t index) {
+        return (LC3Word)(((unsigned char)content[2 * index] << 8) | (unsigned char)content[2 * index + 1]);
+    };
+
+    bool is_obj = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".obj") == 0;
+    if (is_obj) {
+        // LC-3 object file: origin, then the words, all big-endian
+        if (content.size() < 2 || content.size() % 2 != 0) {
+            return -81;
+        }
+        sections.push_back({big_endian_word(0), {}});
+        for (size_t i = 1; i < content.size() / 2; ++i) {
+            sections.back().words.push_back(big_endian_word(i));
+        }
+        return 0;
+    }
+    if (content.size() == kLC3MemoryWords * sizeof(LC3Word) && !IsTextOutput(content)) {
+        // memory image: the program is taken to span the non-zero words
+        size_t first = kLC3MemoryWords, last = 0;
+        for (size_t i = 0; i < kLC3MemoryWords; ++i) {
+            if (big_endian_word(i) != 0) {
+                first = std::min(first, i);
+                last = i;
+            }
+        }
+        if (first != kLC3MemoryWords) {
+            sections.push_back({(unsigned)first, {}});
+            for (size_t i = first; i <= last; ++i) {
+                sections.back().words.push_back(big_endian_word(i));
+            }
+        }
+        return 0;
+    }
+    sections.push_back({default_origin, {}});
+    return ParseTextWords(content, sections.back().words);
+}
+
+// PC-relative operand: the label at the target if there is one, else the offset
+void disassembler::AppendTarget(unsigned address, int offset, std::string &out) const {
+    auto label = labels.find((address + 1 + offset) & 0xFFFF);
+    if (label != labels.end()) {
+        out += label->second;
+    } else {
+        AppendDecimal(offset, out);
+    }
+}
+
+// Words the assembler cannot reproduce exactly (reserved opcode, non-zero
+// unused bits) come out as .FILL, so reassembly always yields the same word
+void disassembler::DisassembleWord(unsigned address, LC3Word word, std::string &out) const {
+    const OpcodeEntry &entry = kOpcodeTable[word >> 12];
+    switch (entry.format) {
+    case FORMAT_BR: {
+        int command = kBranchCommands[(word >> 9) & 7];
+        if (command == -1) {
+            AppendFill(word, out);
+            return;
+        }
+        out += kLC3Commands[command];
+        out += ' ';
+        AppendTarget(address, SignExtend(word, 9), out);
+        return;
+    }
+    case FORMAT_ALU:
+        if ((word & 0x20) == 0 && (word & 0x18) != 0) {
+            AppendFill(word, out);
+            return;
+        }
+        out += kLC3Commands[entry.command];
+        out += ' ';
+        AppendRegister(Dr(word), out);
+        out += ", ";
+        AppendRegister(Sr1(word), out);
+        out += ", ";
+        if (word & 0x20) {
+            AppendDecimal(SignExtend(word, 5), out);
+        } else {
+            AppendRegister(Sr2(word), out);
+        }
+        return;
+    case FORMAT_PCREL:
+        out += kLC3Commands[entry.command];
+        out += ' ';
+        AppendRegister(Dr(word), out);
+        out += ", ";
+        AppendTarget(address, SignExtend(word, 9), out);
+        return;
+    case FORMAT_JSR:
+        if (word & 0x800) {
+            out += kLC3Commands[11];
+            out += ' ';
+            AppendTarget(address, SignExtend(word, 11), out);
+        } else if ((word & 0x0E3F) == 0) {
+            out += kLC3Commands[12];
+            out += ' ';
+            AppendRegister(Sr1(word), out);
+        } else {
+            AppendFill(word, out);
+        }
+        return;
+    case FORMAT_BASE:
+        out += kLC3Commands[entry.command];
+        out += ' ';
+        AppendRegister(Dr(word), out);
+        out += ", ";
+        AppendRegister(Sr1(word), out);
+        out += ", ";
+        AppendDecimal(SignExtend(word, 6), out);
+        return;
+    case FORMAT_NOT:
+        if ((word & 0x3F) != 0x3F) {
+            AppendFill(word, out);
+            return;
+        }
+        out += kLC3Commands[entry.command];
+        out += ' ';
+        AppendRegister(Dr(word), out);
+        out += ", ";
+        AppendRegister(Sr1(word), out);
+        return;
+    case FORMAT_RTI:
+        if (word != 0x8000) {
+            AppendFill(word, out);
+            return;
+        }
+        out += kLC3Commands[entry.command];
+        return;
+    case FORMAT_JMP:
+        if ((word & 0x0E3F) != 0) {
+            AppendFill(word, out);
+        } else if (Sr1(word) == 7) {
+            out += kLC3Commands[18]; // RET
+        } else {
+            out += kLC3Commands[entry.command];
+            out += ' ';
+            AppendRegister(Sr1(word), out);
+        }
+        return;
+    case FORMAT_TRAP:
+        if ((word & 0x0F00) != 0) {
+            AppendFill(word, out);
+        } else if ((word & 0xFF) >= 0x20 && (word & 0xFF) <= 0x25) {
+            out += kLC3TrapRoutine[(word & 0xFF) - 0x20];
+        } else {
+            out += kLC3Commands[entry.command];
+            out += ' ';
+            AppendHex(word & 0xFF, 2, out);
+        }
+        return;
+    default:
+        AppendFill(word, out);
+        return;
+    }
+}
+
+void disassembler::disassemble(const std::vector<ObjectSection> &sections, std::string &out) const {
+    size_t total_words = 0;
+    for (const auto &section : sections) {
+        total_words += section.words.size();
+    }
+    out.reserve(out.size() + total_words * 24 + sections.size() * 32);
+
+    for (const auto &section : sections) {
+        out += ".ORIG ";
+        AppendHex(section.origin, 4, out);
+        out += '\n';
+        unsigned address = section.origin;
+        for (const auto word : section.words) {
+            auto label = labels.find(address);
+            if (label != labels.end()) {
+                out += label->second;
+                out += ' ';
+            } else {
+                out += "    ";
+            }
+            DisassembleWord(address, word, out);
+            out += '\n';
+            ++address;
+        }
+        // a label just past the last word (e.g. on the .END line)
+        auto label = labels.find(address);
+        if (label != labels.end()) {
+            out += label->second;
+            out += '\n';
+        }
+        out += ".END\n";
+    }
+}
+
+int RoundTrip(const std::string &source, std::string &report) {
+    std::string source_filename = source;
+    std::vector<ObjectSection> first_sections;
+    assembler first;
+    auto status = first.encodeSections(source_filename, first_sections);
+    if (status != 0) {
+        report = "assembly failed";
+        return status;
+    }
+
+    // Only labels that land inside (or right after) a section can be
+    // written back, anything else is referenced by offset
+    auto dis = disassembler();
+    for (const auto &label : first.labels().GetLabels()) {
+        for (const auto &section : first_sections) {
+            if (label.second >= section.origin && label.second <= section.origin + section.words.size()) {
+                dis.addSymbol(label.first, label.second);
+                break;
+            }
+        }
+    }
+    std::string text;
+    dis.disassemble(first_sections, text);
+
+    char temp_filename[] = "/tmp/lc3-roundtrip-XXXXXX";
+    int fd = mkstemp(temp_filename);
+    if (fd < 0 || write(fd, text.data(), text.size()) != (ssize_t)text.size()) {
+        report = "cannot write temporary file";
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_filename);
+        }
+        return -20;
+    }
+    close(fd);
+    std::string second_filename = temp_filename;
+    std::vector<ObjectSection> second_sections;
+    assembler second;
+    status = second.encodeSections(second_filename, second_sections);
+    unlink(temp_filename);
+    if (status != 0) {
+        report = "reassembly failed";
+        return status;
+    }
+
+    for (size_t s = 0; s < first_sections.size(); ++s) {
+        const auto &expected = first_sections[s];
+        if (s >= second_sections.size() || second_sections[s].origin != expected.origin) {
+            report = "section layout differs";
+            return -80;
+        }
+        const auto &actual = second_sections[s].words;
+        for (size_t i = 0; i < expected.words.size(); ++i) {
+            if (i >= actual.size() || actual[i] != expected.words[i]) {
+                std::string address;
+                AppendHex(expected.origin + i, 4, address);
+                report = "mismatch at " + address;
+                return -80;
+            }
+        }
+        if (actual.size() != expected.words.size()) {
+            report = "section length differs";
+            return -80;
+        }
+    }
+    if (second_sections.size() != first_sections.size()) {
+        report = "section layout differs";
+        return -80;
+    }
+    report = "ok (" + std::to_string(text.size()) + " bytes of source)";
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * @Description  : table-driven LC-3 disassembler for round-trip verification
+ */
+
+#ifndef ASSEMBLER_DISASSEMBLER_H
+#define ASSEMBLER_DISASSEMBLER_H
+
+#include "object.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class disassembler
+{ // 定义类类型：disassembler反汇编器
+private:
+    std::unordered_map<unsigned, std::string> labels; // 地址到标签的映射
+
+    void DisassembleWord(unsigned address, LC3Word word, std::string &out) const;
+    void AppendTarget(unsigned address, int offset, std::string &out) const;
+
+public:
+    void addSymbol(const std::string &name, unsigned address);
+    int readSymbols(const std::string &sym_filename); // 读入.sym符号表
+
+    // Read assembler output: binary or hex text (origin = `default_origin`),
+    // an .obj file (origin in its first word) or a 64K-word memory image
+    // (one section from the first to the last non-zero word)
+    static int readSections(const std::string &filename, unsigned default_origin,
+                            std::vector<ObjectSection> &sections);
+
+    // Append assembler source for `sections` (one .ORIG/.END block each)
+    void disassemble(const std::vector<ObjectSection> &sections, std::string &out) const;
+};
+
+// Assemble `source`, disassemble the result with its symbols, assemble that
+// again and compare the words: 0 on a fixed point, -80 on a mismatch (with
+// the first differing address in `report`), else the assembler's status
+int RoundTrip(const std::string &source, std::string &report);
+
+#endif
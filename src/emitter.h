@@ -0,0 +1,137 @@
+/*
+ * @Description  : output format policies for pass 2 and the linker
+ *
+ * An emitter fixes, at compile time, how big the output is, where the word
+ * with sequence number `index` at `address` goes and how it is spelled.
+ * Pass 2 is instantiated once per emitter, so its inner loop carries no
+ * output-mode branches; the format is picked once, by the caller's switch
+ * over OutputFormat. A format without kByAddress stores the words in
+ * sequence, with at most the origin of the first, so they must be contiguous
+ * in memory.
+ */
+
+#ifndef ASSEMBLER_EMITTER_H
+#define ASSEMBLER_EMITTER_H
+
+#include "object.h"
+#include "pipe_io.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+enum OutputFormat
+{
+    FORMAT_BINARY_TEXT,   // 每行16位二进制文本
+    FORMAT_HEX_TEXT,      // 每行4位十六进制文本
+    FORMAT_BINARY_OBJECT, // LC3 .obj: 起始地址 + 机器字, 大端
+    FORMAT_MEMORY_IMAGE   // 64K字内存映像, 大端, 按地址存放
+};
+
+// bits of each byte, most significant first
+struct BinaryDigits
+{
+    char digits[256][8];
+    BinaryDigits()
+    {
+        for (int byte = 0; byte < 256; ++byte)
+        {
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                digits[byte][bit] = (byte >> (7 - bit)) & 1 ? '1' : '0';
+            }
+        }
+    }
+};
+
+inline const BinaryDigits &GetBinaryDigits()
+{
+    static const BinaryDigits table;
+    return table;
+}
+
+struct BinaryTextEmitter
+{
+    static const bool kByAddress = false;
+    static const size_t kWordBytes = 17;
+
+    static size_t Size(size_t word_count) { return word_count * kWordBytes; }
+    static void Begin(char *, unsigned) {}
+    static char *At(char *base, size_t index, unsigned) { return base + index * kWordBytes; }
+    static void Put(char *out, LC3Word word)
+    {
+        const BinaryDigits &table = GetBinaryDigits();
+        std::memcpy(out, table.digits[word >> 8], 8);
+        std::memcpy(out + 8, table.digits[word & 0xFF], 8);
+        out[16] = '\n';
+    }
+};
+
+struct HexTextEmitter
+{
+    static const bool kByAddress = false;
+    static const size_t kWordBytes = 5;
+
+    static size_t Size(size_t word_count) { return word_count * kWordBytes; }
+    static void Begin(char *, unsigned) {}
+    static char *At(char *base, size_t index, unsigned) { return base + index * kWordBytes; }
+    static void Put(char *out, LC3Word word)
+    {
+        static const char kDigits[] = "0123456789ABCDEF";
+        out[0] = kDigits[word >> 12];
+        out[1] = kDigits[(word >> 8) & 0xF];
+        out[2] = kDigits[(word >> 4) & 0xF];
+        out[3] = kDigits[word & 0xF];
+        out[4] = '\n';
+    }
+};
+
+struct BinaryObjectEmitter
+{
+    static const bool kByAddress = false;
+    static const size_t kWordBytes = 2;
+
+    static size_t Size(size_t word_count) { return (word_count + 1) * kWordBytes; }
+    static void Begin(char *base, unsigned origin) { Put(base, (LC3Word)origin); }
+    static char *At(char *base, size_t index, unsigned) { return base + (index + 1) * kWordBytes; }
+    static void Put(char *out, LC3Word word)
+    {
+        out[0] = (char)(word >> 8);
+        out[1] = (char)(word & 0xFF);
+    }
+};
+
+struct MemoryImageEmitter
+{
+    static const bool kByAddress = true; // 按地址存放, 需检查越界
+    static const size_t kWordBytes = 2;
+
+    static size_t Size(size_t) { return 65536 * kWordBytes; } // 整个LC3地址空间
+    static void Begin(char *, unsigned) {}
+    static char *At(char *base, size_t, unsigned address) { return base + address * kWordBytes; }
+    static void Put(char *out, LC3Word word) { BinaryObjectEmitter::Put(out, word); }
+};
+
+// Write a contiguous run of words starting at `origin` in one go ("-" for stdout)
+template <class Emitter>
+int WriteWords(const std::string &filename, unsigned origin, const std::vector<LC3Word> &words)
+{
+    if (Emitter::kByAddress && origin + words.size() > 65536)
+    {
+        // @ Error program runs past the end of memory
+        return -22;
+    }
+    OutputBuffer buffer(Emitter::Size(words.size()));
+    if (!buffer.ok())
+    {
+        // @ Error at output file
+        return -20;
+    }
+    Emitter::Begin(buffer.data(), origin);
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        Emitter::Put(Emitter::At(buffer.data(), i, origin + i), words[i]);
+    }
+    return WriteOutput(filename, buffer);
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * @Description  : shared cache of encoded label-free instructions
+ */
+
+#include "encode_cache.h"
+
+EncodeCache::Shard &EncodeCache::ShardOf(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % kShardCount];
+}
+
+bool EncodeCache::Lookup(const std::string &key, LC3Word &word) {
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto item = shard.words.find(key);
+    if (item == shard.words.end()) {
+        return false;
+    }
+    word = item->second;
+    return true;
+}
+
+void EncodeCache::Insert(const std::string &key, LC3Word word) {
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.words.size() < kShardCapacity) {
+        shard.words.insert({key, word});
+    }
+}
+
+void EncodeCache::Clear() {
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.words.clear();
+    }
+}
+
+size_t EncodeCache::size() {
+    size_t count = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        count += shard.words.size();
+    }
+    return count;
+}
+
+EncodeCache &DefaultEncodeCache() {
+    static EncodeCache cache;
+    return cache;
+}
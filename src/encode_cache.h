@@ -0,0 +1,43 @@
+/*
+ * @Description  : shared cache of encoded label-free instructions
+ */
+
+#ifndef ASSEMBLER_ENCODE_CACHE_H
+#define ASSEMBLER_ENCODE_CACHE_H
+
+#include "object.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Maps the normalized text of an instruction (opcode and operands separated
+// by single blanks) to its word. Only instructions whose operands are not
+// labels belong here, their word does not depend on the address or on the
+// file. One cache may be shared by any number of assemblers on any number
+// of threads; the keys are spread over shards with a mutex each.
+class EncodeCache
+{
+private:
+    static const size_t kShardCount = 16;
+    static const size_t kShardCapacity = 4096; // 每个分片的最大条目数, 满后不再插入
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, LC3Word> words;
+    };
+    Shard shards[kShardCount];
+
+    Shard &ShardOf(const std::string &key);
+
+public:
+    bool Lookup(const std::string &key, LC3Word &word);
+    void Insert(const std::string &key, LC3Word word);
+    void Clear();
+    size_t size();
+};
+
+// The cache every assembler uses unless its options name another one
+EncodeCache &DefaultEncodeCache();
+
+#endif
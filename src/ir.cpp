@@ -0,0 +1,186 @@
+/*
+ * @Description  : save and load the state between pass 1 and pass 2
+ */
+
+#include "assembler.h"
+#include "ir.h"
+#include <climits>
+
+namespace {
+
+template <class Record>
+void AppendRecords(std::string &out, const std::vector<Record> &records) {
+    out.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Record));
+}
+
+// Append `name` to the string pool, return its offset
+std::uint32_t PoolName(std::string &pool, const std::string &name) {
+    auto offset = (std::uint32_t)pool.size();
+    pool += name;
+    return offset;
+}
+
+} // namespace
+
+int assembler::writeIR(const std::string &ir_filename) const {
+    std::string pool;
+    std::vector<IRLine> lines;
+    lines.reserve(CommandCount());
+    for (size_t i = 0; i < CommandCount(); ++i) {
+        auto command = Command(i);
+        lines.push_back({command.address, (std::uint32_t)command.type, (std::uint32_t)pool.size(),
+                         (std::uint32_t)command.length});
+        pool.append(command.text, command.length);
+    }
+
+    std::vector<IRSection> ir_sections;
+    for (const auto &section : sections) {
+        ir_sections.push_back({section.origin, (std::uint32_t)section.first_command});
+    }
+
+    // labels by address, so the same source always gives the same file
+    std::vector<std::pair<unsigned, std::string>> labels;
+    for (const auto &label : label_map.GetLabels()) {
+        labels.push_back({label.second, label.first});
+    }
+    std::sort(labels.begin(), labels.end());
+    std::vector<IRSymbol> symbols;
+    for (const auto &label : labels) {
+        size_t section = label_sections.at(label.second);
+        symbols.push_back({IR_LABEL, PoolName(pool, label.second), (std::uint32_t)label.second.size(),
+                           label.first,
+                           section >= sections.size() ? kIRNoSection : (std::uint32_t)section});
+    }
+    std::vector<std::string> external_names(externals.begin(), externals.end());
+    std::sort(external_names.begin(), external_names.end());
+    for (const auto &name : external_names) {
+        symbols.push_back({IR_EXTERNAL, PoolName(pool, name), (std::uint32_t)name.size(), 0, kIRNoSection});
+    }
+    for (const auto &name : globals) {
+        symbols.push_back({IR_GLOBAL, PoolName(pool, name), (std::uint32_t)name.size(), 0, kIRNoSection});
+    }
+    if (pool.size() > UINT32_MAX) {
+        // @ Error program too large for 32 bit offsets
+        return -20;
+    }
+
+    IRHeader header = {};
+    std::memcpy(header.magic, kIRMagic, sizeof(header.magic));
+    header.version = kIRVersion;
+    header.line_count = lines.size();
+    header.section_count = ir_sections.size();
+    header.symbol_count = symbols.size();
+    header.text_size = pool.size();
+
+    std::string image(reinterpret_cast<const char *>(&header), sizeof(header));
+    AppendRecords(image, lines);
+    AppendRecords(image, ir_sections);
+    AppendRecords(image, symbols);
+    image += pool;
+    OutputBuffer output(image.size());
+    if (!output.ok()) {
+        // @ Error at output file
+        return -20;
+    }
+    std::memcpy(output.data(), image.data(), image.size());
+    return WriteOutput(ir_filename, output);
+}
+
+// Map an IR file ("-" for stdin) and take it as the result of pass 1. The
+// line table and texts stay in the mapping; only the symbol table is copied
+// into the hash maps pass 2 looks labels up in.
+int assembler::loadIR(const std::string &ir_filename) {
+    auto open_status = ir_input.open(ir_filename, options.limits.max_input_bytes);
+    if (open_status == -2) {
+        // @ Error input larger than the job allows
+        return -41;
+    }
+    if (open_status != 0) {
+        std::cerr << "Unable to open file" << std::endl;
+        // @ Input file read error
+        return -1;
+    }
+    const char *data = ir_input.data();
+    const size_t size = ir_input.size();
+    IRHeader header;
+    if (size < sizeof(header)) {
+        // @ Error not an IR file
+        return -55;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kIRMagic, sizeof(header.magic)) != 0 || header.version != kIRVersion) {
+        // @ Error not an IR file, or another version
+        return -55;
+    }
+    const std::uint64_t expected_size = sizeof(IRHeader) + (std::uint64_t)header.line_count * sizeof(IRLine) +
+                                        (std::uint64_t)header.section_count * sizeof(IRSection) +
+                                        (std::uint64_t)header.symbol_count * sizeof(IRSymbol) +
+                                        header.text_size;
+    if (expected_size != size) {
+        // @ Error truncated or inconsistent IR file
+        return -56;
+    }
+
+    auto lines = reinterpret_cast<const IRLine *>(data + sizeof(IRHeader));
+    auto ir_sections = reinterpret_cast<const IRSection *>(lines + header.line_count);
+    auto symbols = reinterpret_cast<const IRSymbol *>(ir_sections + header.section_count);
+    auto text = reinterpret_cast<const char *>(symbols + header.symbol_count);
+    auto in_pool = [&header](std::uint32_t offset, std::uint32_t length) {
+        return offset <= header.text_size && length <= header.text_size - offset;
+    };
+    for (std::uint32_t i = 0; i < header.line_count; ++i) {
+        if (!in_pool(lines[i].text_offset, lines[i].text_length) || lines[i].type > PSEUDO) {
+            // @ Error truncated or inconsistent IR file
+            return -56;
+        }
+        if (lines[i].type == PSEUDO) {
+            // pass 2 sizes the output from these operands: check them as pass 1 did
+            std::string command(text + lines[i].text_offset, lines[i].text_length);
+            auto first_whitespace_position = command.find(' ');
+            auto operand = first_whitespace_position == std::string::npos
+                               ? std::string()
+                               : command.substr(first_whitespace_position + 1);
+            if (PseudoOperandStatus(command.substr(0, first_whitespace_position), operand) != 0) {
+                // @ Error inconsistent IR file
+                return -56;
+            }
+        }
+    }
+
+    sections.clear();
+    for (std::uint32_t i = 0; i < header.section_count; ++i) {
+        if (ir_sections[i].first_line > header.line_count ||
+            (i > 0 && ir_sections[i].first_line < ir_sections[i - 1].first_line)) {
+            // @ Error truncated or inconsistent IR file
+            return -56;
+        }
+        sections.push_back({ir_sections[i].origin, ir_sections[i].first_line});
+    }
+    label_map.Clear();
+    label_sections.clear();
+    externals.clear();
+    globals.clear();
+    for (std::uint32_t i = 0; i < header.symbol_count; ++i) {
+        const IRSymbol &symbol = symbols[i];
+        if (!in_pool(symbol.name_offset, symbol.name_length) || symbol.kind > IR_GLOBAL) {
+            // @ Error truncated or inconsistent IR file
+            return -56;
+        }
+        std::string name(text + symbol.name_offset, symbol.name_length);
+        if (symbol.kind == IR_EXTERNAL) {
+            externals.insert(name);
+        } else if (symbol.kind == IR_GLOBAL) {
+            globals.push_back(name);
+        } else {
+            label_map.AddLabel(name, symbol.address);
+            label_sections.insert(
+                {name, symbol.section == kIRNoSection ? (size_t)-1 : (size_t)symbol.section});
+        }
+    }
+
+    commands.clear();
+    ir_lines = lines;
+    ir_line_count = header.line_count;
+    ir_text = text;
+    return 0;
+}
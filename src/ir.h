@@ -0,0 +1,64 @@
+/*
+ * @Description  : binary intermediate representation between pass 1 and 2
+ *
+ * IR file layout (native byte order, every field 32 bits):
+ *   IRHeader
+ *   IRLine    [line_count]     one per pass 1 command, text in the pool
+ *   IRSection [section_count]  one per .ORIG
+ *   IRSymbol  [symbol_count]   labels, .EXTERNAL and .GLOBAL names
+ *   char      [text_size]      string pool, no terminators
+ * A loaded IR is mapped, and pass 2 reads the line texts straight out of
+ * the mapping.
+ */
+
+#ifndef ASSEMBLER_IR_H
+#define ASSEMBLER_IR_H
+
+#include <cstdint>
+
+const char kIRMagic[5] = {'L', 'C', '3', 'I', 'R'};
+const std::uint8_t kIRVersion = 1;
+const std::uint32_t kIRNoSection = 0xFFFFFFFF; // 第一个.ORIG之前的标签
+
+struct IRHeader
+{
+    char magic[5];          // "LC3IR"
+    std::uint8_t version;
+    std::uint8_t reserved[2];
+    std::uint32_t line_count;
+    std::uint32_t section_count;
+    std::uint32_t symbol_count;
+    std::uint32_t text_size;
+};
+
+struct IRLine
+{
+    std::uint32_t address;
+    std::uint32_t type;        // CommandType
+    std::uint32_t text_offset;
+    std::uint32_t text_length;
+};
+
+struct IRSection
+{
+    std::uint32_t origin;
+    std::uint32_t first_line;
+};
+
+enum IRSymbolKind
+{
+    IR_LABEL,    // 本模块定义的标签
+    IR_EXTERNAL, // .EXTERNAL
+    IR_GLOBAL    // .GLOBAL
+};
+
+struct IRSymbol
+{
+    std::uint32_t kind;        // IRSymbolKind
+    std::uint32_t name_offset;
+    std::uint32_t name_length;
+    std::uint32_t address;     // 仅IR_LABEL
+    std::uint32_t section;     // 仅IR_LABEL, kIRNoSection表示不在任何段内
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * @Description  : place relocatable modules, resolve imports, emit the image
+ */
+
+#include "linker.h"
+#include "assembler.h"
+
+int linker::addObject(const std::string &object_filename) {
+    ObjectModule module;
+    auto status = ReadObjectModule(object_filename, module);
+    if (status != 0) {
+        return status;
+    }
+    modules.push_back(std::move(module));
+    return 0;
+}
+
+// Every section keeps the address given by its .ORIG; sections of all
+// modules must not overlap and must fit into the 64K address space
+int linker::placeSections() {
+    std::vector<std::pair<unsigned, size_t>> ranges; // (起始地址, 字数)
+    for (const auto &module : modules) {
+        for (const auto &section : module.sections) {
+            ranges.push_back({section.origin, section.words.size()});
+        }
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        unsigned end = ranges[i].first + ranges[i].second;
+        if (end > 0x10000 || (i + 1 < ranges.size() && end > ranges[i + 1].first)) {
+            // @ Error overlapping sections
+            return -60;
+        }
+    }
+
+    for (size_t m = 0; m < modules.size(); ++m) {
+        for (const auto &symbol : modules[m].symbols) {
+            if (!symbol.exported) {
+                continue;
+            }
+            unsigned address = modules[m].sections[symbol.section].origin + symbol.offset;
+            if (!global_symbols.insert({symbol.name, {m, address}}).second) {
+                // @ Error label exported by more than one module
+                return -61;
+            }
+        }
+    }
+    return 0;
+}
+
+int linker::resolveRelocations() {
+    for (size_t m = 0; m < modules.size(); ++m) {
+        auto &module = modules[m];
+        // a module's own labels take precedence over other modules' exports
+        std::unordered_map<std::string, unsigned> local_symbols;
+        for (const auto &symbol : module.symbols) {
+            local_symbols.insert({symbol.name, module.sections[symbol.section].origin + symbol.offset});
+        }
+
+        for (const auto &relocation : module.relocations) {
+            int target;
+            auto local = local_symbols.find(relocation.symbol);
+            if (local != local_symbols.end()) {
+                target = local->second;
+            } else {
+                auto global = global_symbols.find(relocation.symbol);
+                if (global == global_symbols.end()) {
+                    // @ Error undefined external label
+                    return -62;
+                }
+                target = global->second.address;
+            }
+
+            auto &section = module.sections[relocation.section];
+            int offset = target - (int)(section.origin + relocation.offset) - 1; // PCoffset
+            int limit = 1 << (relocation.width - 1);
+            if (offset < -limit || offset >= limit) {
+                // @ Error label out of PCoffset range
+                return -63;
+            }
+            LC3Word mask = (LC3Word)((1 << relocation.width) - 1);
+            auto &word = section.words[relocation.offset];
+            word = (LC3Word)((word & ~mask) | (offset & mask));
+        }
+    }
+    return 0;
+}
+
+// Write the placed sections from the lowest to the highest address in the
+// selected output format, filling the gaps between them with zero words
+int linker::writeImage(std::string &output_filename) const {
+    std::vector<const ObjectSection *> placed;
+    for (const auto &module : modules) {
+        for (const auto &section : module.sections) {
+            if (!section.words.empty()) {
+                placed.push_back(&section);
+            }
+        }
+    }
+    std::sort(placed.begin(), placed.end(), [](const ObjectSection *a, const ObjectSection *b) {
+        return a->origin < b->origin;
+    });
+
+    unsigned origin = placed.empty() ? 0 : placed.front()->origin;
+    std::vector<LC3Word> words;
+    for (const auto *section : placed) {
+        words.resize(section->origin - origin, 0);
+        words.insert(words.end(), section->words.begin(), section->words.end());
+    }
+    switch (format) {
+    case FORMAT_HEX_TEXT:
+        return WriteWords<HexTextEmitter>(output_filename, origin, words);
+    case FORMAT_BINARY_OBJECT:
+        return WriteWords<BinaryObjectEmitter>(output_filename, origin, words);
+    case FORMAT_MEMORY_IMAGE:
+        return WriteWords<MemoryImageEmitter>(output_filename, origin, words);
+    default:
+        return WriteWords<BinaryTextEmitter>(output_filename, origin, words);
+    }
+}
+
+// 链接主功能函数——若正确则返回0，否则返回对应错误码
+int linker::link(std::string &output_filename) {
+    auto place_status = placeSections();
+    if (place_status != 0) {
+        return place_status;
+    }
+    auto resolve_status = resolveRelocations();
+    if (resolve_status != 0) {
+        return resolve_status;
+    }
+    return writeImage(output_filename);
+}
@@ -0,0 +1,38 @@
+/*
+ * @Description  : a small linker for relocatable LC-3 object modules
+ */
+
+#ifndef ASSEMBLER_LINKER_H
+#define ASSEMBLER_LINKER_H
+
+#include "emitter.h"
+#include "object.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class linker
+{ // 定义类类型：linker链接器
+    struct PlacedSymbol
+    {
+        size_t module;
+        unsigned address; // 链接后的绝对地址
+    };
+
+private:
+    std::vector<ObjectModule> modules;
+    std::unordered_map<std::string, PlacedSymbol> global_symbols; // 所有模块导出的标签
+    OutputFormat format;                                          // 输出格式
+
+    int placeSections();
+    int resolveRelocations();
+    int writeImage(std::string &output_filename) const;
+
+public:
+    explicit linker(OutputFormat format = FORMAT_BINARY_TEXT) : format(format) {}
+
+    int addObject(const std::string &object_filename); // 读入一个目标文件
+    int link(std::string &output_filename);            // 链接并输出最终映像
+};
+
+#endif
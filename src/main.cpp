@@ -7,9 +7,17 @@
  */
 
 #include "assembler.h"
+#include "alloc_stats.h"
+#include "disassembler.h"
+#include "linker.h"
+#include "parallel.h"
+#include "watch.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
 
-bool gIsErrorLogMode = false;   //设置纠错调试模式
-bool gIsHexMode = false;        //设置16进制输出模式
 // A simple arguments parser
 std::pair<bool, std::string> getCmdOption(char **begin, char **end,
                                           const std::string &option) {  //获取命令行指令输入
@@ -20,10 +28,92 @@ std::pair<bool, std::string> getCmdOption(char **begin, char **end,
     return std::make_pair(false, "");
 }
 
+std::vector<std::string> getCmdOptions(char **begin, char **end,
+                                       const std::string &option) {  //获取重复出现的命令行选项(如多个-f)
+    std::vector<std::string> values;
+    for (char **itr = begin; itr != end; ++itr) {
+        if (option == *itr && itr + 1 != end) {
+            values.push_back(*++itr);
+        }
+    }
+    return values;
+}
+
+// A non-negative decimal option value (e.g. -j 8); false unless the whole
+// string is one
+bool parseCountOption(const std::string &text, unsigned long &value) {
+    const char *begin = text.c_str();
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtoul(begin, &end, 10);
+    return end != begin && *end == '\0' && errno == 0 && text[0] != '-' && text[0] != '+' &&
+           !std::isspace((unsigned char)text[0]);
+}
+
 bool cmdOptionExists(char **begin, char **end, const std::string &option) {  //是否输入附加命令选项-e/-s/-h
     return std::find(begin, end, option) != end;
 }
 
+std::string defaultOutputFilename(const std::string &input_filename) {
+    std::string output_filename = input_filename;   //若未输入output文件路径的处理方式,在input文件名后加上my后缀
+    if (output_filename.find('.') == std::string::npos) {
+        output_filename = output_filename + "my.bin";
+    } else {
+        output_filename =
+            output_filename.substr(0, output_filename.rfind('.'));
+        output_filename = output_filename + "my.bin";
+    }
+    return output_filename;
+}
+
+// The object file of a source module: same stem, object extension
+std::string objectFilename(const std::string &source_filename) {
+    auto dot = source_filename.rfind('.');
+    auto slash = source_filename.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return source_filename + kObjectExtension;
+    }
+    return source_filename.substr(0, dot) + kObjectExtension;
+}
+
+bool isObjectFilename(const std::string &filename) {
+    return filename.size() > kObjectExtension.size() &&
+           filename.compare(filename.size() - kObjectExtension.size(), kObjectExtension.size(),
+                            kObjectExtension) == 0;
+}
+
+// A module is reassembled only when its object is missing or older than the source
+bool objectIsStale(const std::string &source_filename, const std::string &object_filename) {
+    struct stat source_stat, object_stat;
+    if (stat(object_filename.c_str(), &object_stat) != 0 ||
+        stat(source_filename.c_str(), &source_stat) != 0) {
+        return true;
+    }
+    return object_stat.st_mtim.tv_sec < source_stat.st_mtim.tv_sec ||
+           (object_stat.st_mtim.tv_sec == source_stat.st_mtim.tv_sec &&
+            object_stat.st_mtim.tv_nsec < source_stat.st_mtim.tv_nsec);
+}
+
+// Assemble (source, object) pairs on all cores, one assembler per module.
+// Returns the status of the first failing module in input order.
+int assembleModules(std::vector<std::pair<std::string, std::string>> &jobs,
+                    const AssemblerOptions &options) {
+    std::vector<int> statuses(jobs.size(), 0);
+    ParallelFor(jobs.size(), DefaultThreadCount(), [&](size_t i) {
+        assembler ass(options);
+        statuses[i] = ass.assembleObject(jobs[i].first, jobs[i].second);
+    });
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (statuses[i] != 0) {
+            if (options.error_log) {
+                std::cout << jobs[i].first << ": " << std::dec << statuses[i] << std::endl;
+            }
+            return statuses[i];
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     // Print out Basic information about the assembler
     if (cmdOptionExists(argv, argv + argc, "-h")) {
@@ -35,10 +125,41 @@ int main(int argc, char **argv) {
                   << std::endl;
         std::cout << "\e[1mOptions\e[0m" << std::endl;
         std::cout << "-h : print out help information" << std::endl;  //显示帮助信息
-        std::cout << "-f : the path for the input file" << std::endl; //待编译文件输入路径
+        std::cout << "-f : the path for the input file (- for stdin)" << std::endl; //待编译文件输入路径
         std::cout << "-e : print out error information" << std::endl; //以纠错调试模式运行
-        std::cout << "-o : the path for the output file" << std::endl; //编译完成文件输出路径
-        std::cout << "-s : hex mode" << std::endl; //以十六进制模式转换输出
+        std::cout << "-o : the path for the output file (- for stdout, the default with -f -)" << std::endl; //编译完成文件输出路径
+        std::cout << "-s : hex mode (same as -F hex)" << std::endl; //以十六进制模式转换输出
+        std::cout << "-p : write the output from several threads through a memory mapping"
+                  << std::endl; //多线程映射输出
+        std::cout << "-m : write a raw 64K-word big-endian memory image (same as -F img)"
+                  << std::endl; //内存映像输出
+        std::cout << "-F : output format, bin (default), hex, obj (LC-3 object) or img"
+                  << std::endl; //输出格式
+        std::cout << "-j : number of output threads for -p/-m" << std::endl; //输出线程数
+        std::cout << "-t : give up after this many milliseconds (status -40)" << std::endl; //时间限制
+        std::cout << "-M : largest input in bytes (status -41)" << std::endl; //输入大小限制
+        std::cout << "-W : most output words (status -42)" << std::endl; //输出字数限制
+        std::cout << "-c : assemble every -f input into a relocatable object ("
+                  << kObjectExtension << ")" << std::endl; //仅汇编为目标文件
+        std::cout << "-l : link every -f input (sources are reassembled only when changed)"
+                  << std::endl; //链接多个模块
+        std::cout << "-bin/-hex/-obj/-img/-lst : write these outputs (binary, hex, LC-3 .obj, memory "
+                     "image, listing) from one encoding; -sym may be added, and -o for a format not named"
+                  << std::endl; //一次输出多种格式
+        std::cout << "-i : write the state after pass 1 to this IR file (alone: skip pass 2)"
+                  << std::endl; //输出中间表示
+        std::cout << "-I : load an IR file instead of the source and run pass 2 only (also with -c)"
+                  << std::endl; //读入中间表示
+        std::cout << "-sym : also write the symbol table to this path (input symbols with -d)"
+                  << std::endl; //符号表路径
+        std::cout << "-d : disassemble the -f input (text, hex, .obj or memory image)"
+                  << std::endl; //反汇编
+        std::cout << "-orig : origin for disassembling text output (default x3000)"
+                  << std::endl; //反汇编起始地址
+        std::cout << "-r : check every -f input for an assemble/disassemble/assemble fixed point"
+                  << std::endl; //往返校验
+        std::cout << "-w : watch the -f inputs and reassemble edited lines incrementally (bin or hex)"
+                  << std::endl; //监视模式
         return 0;
     }
 
@@ -46,10 +167,14 @@ int main(int argc, char **argv) {
     std::string input_filename;
     auto output_info = getCmdOption(argv, argv + argc, "-o");
     std::string output_filename;
+    auto ir_dump_info = getCmdOption(argv, argv + argc, "-i");
+    auto ir_load_info = getCmdOption(argv, argv + argc, "-I");
 
     // Check the input file name
     if (input_info.first) {
         input_filename = input_info.second;
+    } else if (ir_load_info.first) {
+        input_filename = ir_load_info.second; // 仅用于生成默认输出文件名
     } else {
         input_filename = "input.txt";
     }
@@ -62,32 +187,243 @@ int main(int argc, char **argv) {
 
     // Check output file name
     if (output_filename.empty()) {
-        output_filename = input_filename;   //若未输入output文件路径的处理方式,在input文件名后加上my后缀
-        if (output_filename.find('.') == std::string::npos) {
-            output_filename = output_filename + "my.bin";
-        } else {
-            output_filename =
-                output_filename.substr(0, output_filename.rfind('.'));
-            output_filename = output_filename + "my.bin";
-        }
+        // 从stdin读入时默认输出到stdout
+        output_filename = IsStdioFilename(input_filename) ? input_filename
+                                                          : defaultOutputFilename(input_filename);
     }
 
+    AssemblerOptions options; // 本次运行的汇编选项
     if (cmdOptionExists(argv, argv + argc, "-e")) {
         // * Error Log Mode :
         // * With error log mode, we can show error type
-        SetErrorLogMode(true);
+        options.error_log = true;
     }
     if (cmdOptionExists(argv, argv + argc, "-s")) {
         // * Hex Mode:
         // * With hex mode, the result file is shown in hex
-        SetHexMode(true);
+        options.format = FORMAT_HEX_TEXT;
+    }
+    if (cmdOptionExists(argv, argv + argc, "-p")) {
+        // * Mapped Mode:
+        // * Preallocate the output and let worker threads format their words in place
+        options.mapped = true;
+    }
+    if (cmdOptionExists(argv, argv + argc, "-m")) {
+        // * Image Mode:
+        // * The result file is the whole 64K-word memory, two bytes per word
+        options.format = FORMAT_MEMORY_IMAGE;
+    }
+    auto format_info = getCmdOption(argv, argv + argc, "-F");
+    if (format_info.first) {
+        // * Output Format:
+        // * Every word of the output is written in this one format
+        if (format_info.second == "hex") {
+            options.format = FORMAT_HEX_TEXT;
+        } else if (format_info.second == "obj") {
+            options.format = FORMAT_BINARY_OBJECT;
+        } else if (format_info.second == "img") {
+            options.format = FORMAT_MEMORY_IMAGE;
+        } else {
+            options.format = FORMAT_BINARY_TEXT;
+        }
+    }
+    int option_status = 0; // 数值选项的解析结果
+    unsigned long value = 0;
+    auto threads_info = getCmdOption(argv, argv + argc, "-j");
+    if (threads_info.first) {
+        if (parseCountOption(threads_info.second, value) && value <= UINT_MAX) {
+            options.output_threads = value;
+        } else {
+            option_status = -25;
+        }
+    }
+    // * Job limits: stop with -40 past the deadline, -41 on a larger input and
+    // * -42 on more output words
+    auto deadline_info = getCmdOption(argv, argv + argc, "-t");
+    if (deadline_info.first) {
+        if (parseCountOption(deadline_info.second, value)) {
+            auto now = std::chrono::steady_clock::now();
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::time_point::max() - now);
+            if (value < (unsigned long)remaining.count()) {
+                options.limits.deadline = now + std::chrono::milliseconds(value);
+            } // 更远的截止时间等于不限
+        } else {
+            option_status = -25;
+        }
+    }
+    auto input_limit_info = getCmdOption(argv, argv + argc, "-M");
+    if (input_limit_info.first) {
+        if (parseCountOption(input_limit_info.second, value)) {
+            options.limits.max_input_bytes = value;
+        } else {
+            option_status = -25;
+        }
+    }
+    auto output_limit_info = getCmdOption(argv, argv + argc, "-W");
+    if (output_limit_info.first) {
+        if (parseCountOption(output_limit_info.second, value)) {
+            options.limits.max_output_words = value;
+        } else {
+            option_status = -25;
+        }
     }
 
-    auto ass = assembler();
-    auto status = ass.assemble(input_filename, output_filename); //汇编器主功能函数
+    int status;
+    auto sym_info = getCmdOption(argv, argv + argc, "-sym");
+    auto input_filenames = getCmdOptions(argv, argv + argc, "-f");
+    if (input_filenames.empty()) {
+        input_filenames.push_back(input_filename);
+    }
+    if (option_status != 0) {
+        // @ Error -j, -t, -M or -W is not a non-negative number
+        std::cerr << "-j, -t, -M and -W take a non-negative number" << std::endl;
+        status = option_status;
+    } else if (cmdOptionExists(argv, argv + argc, "-c") && ir_load_info.first) {
+        // * Relocatable object from a saved IR: pass 2 only
+        assembler ass(options);
+        status = ass.loadIR(ir_load_info.second);
+        if (status == 0) {
+            std::string object_filename =
+                output_info.first ? output_info.second : objectFilename(ir_load_info.second);
+            status = ass.emitObject(object_filename);
+        }
+    } else if (cmdOptionExists(argv, argv + argc, "-c")) {
+        // * Separate assembly: one object file per input module
+        std::vector<std::pair<std::string, std::string>> jobs;
+        for (const auto &source : input_filenames) {
+            jobs.push_back({source, objectFilename(source)});
+        }
+        if (jobs.size() == 1 && output_info.first) {
+            jobs[0].second = output_info.second;
+        }
+        status = assembleModules(jobs, options);
+    } else if (cmdOptionExists(argv, argv + argc, "-l")) {
+        // * Link: reassemble the changed sources, then link all objects
+        std::vector<std::pair<std::string, std::string>> jobs;
+        std::vector<std::string> object_filenames;
+        for (const auto &input : input_filenames) {
+            if (isObjectFilename(input)) {
+                object_filenames.push_back(input);
+                continue;
+            }
+            object_filenames.push_back(objectFilename(input));
+            if (objectIsStale(input, object_filenames.back())) {
+                jobs.push_back({input, object_filenames.back()});
+            }
+        }
+        status = assembleModules(jobs, options);
+        auto lnk = linker(options.format);
+        for (size_t i = 0; status == 0 && i < object_filenames.size(); ++i) {
+            status = lnk.addObject(object_filenames[i]);
+        }
+        if (status == 0) {
+            status = lnk.link(output_filename);
+        }
+    } else if (cmdOptionExists(argv, argv + argc, "-w")) {
+        // * Watch mode: rebuild incrementally on every save until interrupted
+        std::vector<std::pair<std::string, std::string>> files;
+        for (const auto &source : input_filenames) {
+            files.push_back({source, defaultOutputFilename(source)});
+        }
+        if (files.size() == 1) {
+            files[0].second = output_filename;
+        }
+        status = WatchFiles(files, options);
+    } else if (cmdOptionExists(argv, argv + argc, "-d")) {
+        // * Disassemble: assembler output back into source
+        auto dis = disassembler();
+        status = sym_info.first ? dis.readSymbols(sym_info.second) : 0;
+        auto orig_info = getCmdOption(argv, argv + argc, "-orig");
+        unsigned origin = orig_info.first ? RecognizeNumberValue(orig_info.second) : 0x3000;
+        std::vector<ObjectSection> sections;
+        if (status == 0) {
+            status = disassembler::readSections(input_filename, origin, sections);
+        }
+        if (status == 0) {
+            std::string text;
+            dis.disassemble(sections, text);
+            if (output_info.first) {
+                status = WriteOutput(output_info.second, text);
+            } else {
+                std::cout << text;
+            }
+        }
+    } else if (cmdOptionExists(argv, argv + argc, "-r")) {
+        // * Round trip: every input must reassemble to the same words
+        std::vector<int> statuses(input_filenames.size(), 0);
+        std::vector<std::string> reports(input_filenames.size());
+        ParallelFor(input_filenames.size(), DefaultThreadCount(), [&](size_t i) {
+            statuses[i] = RoundTrip(input_filenames[i], reports[i]);
+        });
+        status = 0;
+        for (size_t i = 0; i < input_filenames.size(); ++i) {
+            std::cout << input_filenames[i] << ": " << reports[i] << std::endl;
+            if (status == 0) {
+                status = statuses[i];
+            }
+        }
+    } else {
+        // * Assemble: pass 1 from the source or a saved IR, then pass 2. With
+        // * -i and no -o only the IR is written.
+        assembler ass(options);
+        status = ir_load_info.first ? ass.loadIR(ir_load_info.second) : ass.parse(input_filename);
+        if (status == 0 && ir_dump_info.first) {
+            status = ass.writeIR(ir_dump_info.second);
+        }
+        OutputSet outputs;
+        outputs.binary_text = getCmdOption(argv, argv + argc, "-bin").second;
+        outputs.hex_text = getCmdOption(argv, argv + argc, "-hex").second;
+        outputs.binary_object = getCmdOption(argv, argv + argc, "-obj").second;
+        outputs.memory_image = getCmdOption(argv, argv + argc, "-img").second;
+        outputs.listing = getCmdOption(argv, argv + argc, "-lst").second;
+        bool several_outputs = !outputs.binary_text.empty() || !outputs.hex_text.empty() ||
+                               !outputs.binary_object.empty() || !outputs.memory_image.empty() ||
+                               !outputs.listing.empty();
+        if (status == 0 && several_outputs) {
+            // * Several outputs: encode once, write every requested format
+            outputs.symbols = sym_info.second;
+            std::string *format_output;
+            switch (options.format) {
+            case FORMAT_HEX_TEXT:
+                format_output = &outputs.hex_text;
+                break;
+            case FORMAT_BINARY_OBJECT:
+                format_output = &outputs.binary_object;
+                break;
+            case FORMAT_MEMORY_IMAGE:
+                format_output = &outputs.memory_image;
+                break;
+            default:
+                format_output = &outputs.binary_text;
+                break;
+            }
+            if (output_info.first && !format_output->empty() && *format_output != output_filename) {
+                // @ Error -o and the flag of its format name two different paths
+                std::cerr << "-o conflicts with the path given for its format" << std::endl;
+                status = -24;
+            } else {
+                if (output_info.first) {
+                    *format_output = output_filename;
+                }
+                status = ass.emitAll(outputs);
+            }
+        } else {
+            if (status == 0 && (!ir_dump_info.first || output_info.first || ir_load_info.first)) {
+                status = ass.emit(output_filename); //汇编器主功能函数
+            }
+            if (status == 0 && sym_info.first) {
+                status = ass.writeSymbols(sym_info.second);
+            }
+        }
+    }
 
-    if (gIsErrorLogMode) {
-        std::cout << std::dec << status << std::endl;
+    if (options.error_log) {
+        // keep the status out of an output written to stdout
+        bool to_stdout = IsStdioFilename(output_filename) || IsStdioFilename(sym_info.second);
+        (to_stdout ? std::cerr : std::cout) << std::dec << status << std::endl;
     }
+    // Only prints when built with `make ALLOC_STATS=1`
+    ReportAllocStats(std::cerr);
     return 0;
 }
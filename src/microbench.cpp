@@ -0,0 +1,323 @@
+/*
+ * @Description  : microbenchmarks for the per-line helpers (`make bench`)
+ *
+ * Every benchmark runs a fixed number of calls per sample over a fixed
+ * corpus and reports ns per call over several samples. Results can be saved
+ * with -o and two saved runs compared with -c, e.g.
+ *   ./microbench -o before.tsv ... ./microbench -o after.tsv
+ *   ./microbench -c before.tsv after.tsv
+ */
+
+#include "assembler.h"
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+// Reaches the private per-line members of assembler
+struct AssemblerBenchAccess
+{
+    static std::string LineLabelSplit(assembler &ass, const std::string &line, int address)
+    {
+        return ass.LineLabelSplit(line, address);
+    }
+    static std::string TranslateCommand(assembler &ass, std::stringstream &stream, unsigned address)
+    {
+        return ass.TranslateCommand(stream, address);
+    }
+    static void TranslateWords(assembler &ass, const std::string &command, std::vector<LC3Word> &words)
+    {
+        ass.TranslateWords({0x3008u, command.data(), command.size(), OPERATION}, words);
+    }
+    static LabelMapType &Labels(assembler &ass)
+    {
+        return ass.label_map;
+    }
+};
+
+namespace {
+
+const int kCallsPerSample = 20000; // 每个样本的固定调用次数
+const int kDefaultSamples = 15;
+const double kRegressionThreshold = 0.05; // 比较时超过5%视为回退
+
+volatile size_t gSink; // keeps results alive
+
+struct Result
+{
+    std::string name;
+    double median;
+    double mean;
+    double stddev;
+    double min;
+    int samples;
+};
+
+// Source lines as they appear in course and generated programs
+const std::vector<std::string> kLineCorpus = {
+    "        .ORIG x3000",
+    "START   AND R0, R0, #0          ; clear R0",
+    "        add r1, r1, #1",
+    "        LD R2, DATA",
+    "LOOP    ADD R0, R0, #-1",
+    "        BRp LOOP",
+    "\tJSR SUB\t; call",
+    "        NOT R4, R5",
+    "        LDR R6, R7, #-2",
+    "        STR R6, R7, #3",
+    "        TRAP x25",
+    "SUB     RET",
+    "; a comment line",
+    "",
+    "DATA    .FILL x1234",
+    "MSG     .STRINGZ \"Hello\"",
+    "ARR     .BLKW 3",
+};
+
+const std::vector<std::string> kOperandCorpus = {
+    "#1", "#-16", "x3000", "xFFFF", "15", "#100", "x25", "#-1", "0", "xBEEF",
+};
+
+const std::vector<std::string> kBinaryCorpus = {
+    "0101000000100000", "0001001001100001", "0010010000010010", "1110011000010101",
+    "0000001111111110", "1111000000100101", "1100000111000000", "0000000000000000",
+};
+
+// One instruction per kLC3Commands entry, plus the trap aliases
+const std::vector<std::string> kCommandCorpus = {
+    "ADD R1 R2 #-3", "AND R0 R0 R1",  "BR LOOP",     "BRN LOOP",    "BRZ LOOP",
+    "BRP LOOP",      "BRNZ LOOP",     "BRNP LOOP",   "BRZP LOOP",   "BRNZP LOOP",
+    "JMP R2",        "JSR SUB",       "JSRR R3",     "LD R2 DATA",  "LDI R1 DATA",
+    "LDR R6 R7 #-2", "LEA R3 DATA",   "NOT R4 R5",   "RET",         "RTI",
+    "ST R2 DATA",    "STI R2 DATA",   "STR R6 R7 #3", "TRAP X25",   "HALT",
+};
+
+// The label-free part of the corpus, the lines the encode cache can serve
+const std::vector<std::string> kLabelFreeCorpus = {
+    "ADD R1 R1 #1", "AND R0 R0 #0", "NOT R4 R5", "LDR R6 R7 #-2", "STR R6 R7 #3",
+    "JMP R2",       "JSRR R3",      "RET",       "TRAP X25",      "HALT",
+};
+
+Result Measure(const std::string &name, int samples, const std::function<void()> &call) {
+    for (int i = 0; i < kCallsPerSample / 10; ++i) {
+        call(); // warm up caches and the allocator
+    }
+    std::vector<double> per_call(samples);
+    for (int s = 0; s < samples; ++s) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCallsPerSample; ++i) {
+            call();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        per_call[s] = elapsed.count() / kCallsPerSample;
+    }
+    std::sort(per_call.begin(), per_call.end());
+    double mean = 0;
+    for (auto value : per_call) {
+        mean += value;
+    }
+    mean /= samples;
+    double variance = 0;
+    for (auto value : per_call) {
+        variance += (value - mean) * (value - mean);
+    }
+    double median = samples % 2 ? per_call[samples / 2]
+                                : (per_call[samples / 2 - 1] + per_call[samples / 2]) / 2;
+    return {name, median, mean, std::sqrt(variance / samples), per_call.front(), samples};
+}
+
+std::vector<Result> RunAll(int samples, const std::string &filter) {
+    std::vector<std::pair<std::string, std::function<void()>>> benches;
+    size_t next = 0; // corpus cursor shared by the closures below
+
+    benches.push_back({"FormatLine", [&]() {
+        std::string line = kLineCorpus[next++ % kLineCorpus.size()];
+        gSink = gSink + FormatLine(line).size();
+    }});
+    benches.push_back({"Trim", [&]() {
+        std::string line = kLineCorpus[next++ % kLineCorpus.size()];
+        gSink = gSink + Trim(line).size();
+    }});
+    benches.push_back({"RecognizeNumberValue", [&]() {
+        gSink = gSink + RecognizeNumberValue(kOperandCorpus[next++ % kOperandCorpus.size()]);
+    }});
+    benches.push_back({"NumberToAssemble/int", [&]() {
+        gSink = gSink + NumberToAssemble((int)(next++ & 0xFFFF)).size();
+    }});
+    benches.push_back({"NumberToAssemble/string", [&]() {
+        gSink = gSink + NumberToAssemble(kOperandCorpus[next++ % kOperandCorpus.size()]).size();
+    }});
+    benches.push_back({"ConvertBin2Hex", [&]() {
+        gSink = gSink + ConvertBin2Hex(kBinaryCorpus[next++ % kBinaryCorpus.size()]).size();
+    }});
+
+    assembler split_assembler;
+    std::vector<std::string> formatted_lines;
+    for (auto line : kLineCorpus) {
+        line = FormatLine(line);
+        if (!line.empty()) {
+            formatted_lines.push_back(line);
+        }
+    }
+    benches.push_back({"LineLabelSplit", [&]() {
+        gSink = gSink + AssemblerBenchAccess::LineLabelSplit(
+                            split_assembler, formatted_lines[next++ % formatted_lines.size()], 0x3000)
+                            .size();
+    }});
+
+    // A symbol table of realistic size; half of the lookups miss
+    LabelMapType label_map;
+    std::vector<std::string> label_queries;
+    for (int i = 0; i < 1000; ++i) {
+        label_map.AddLabel("LABEL" + std::to_string(i), 0x3000 + i);
+        label_queries.push_back((i % 2 ? "LABEL" : "MISS") + std::to_string(i));
+    }
+    benches.push_back({"LabelMapType::GetAddress", [&]() {
+        gSink = gSink + label_map.GetAddress(label_queries[next++ % label_queries.size()]);
+    }});
+
+    assembler translate_assembler;
+    auto &labels = AssemblerBenchAccess::Labels(translate_assembler);
+    labels.AddLabel("LOOP", 0x3004);
+    labels.AddLabel("SUB", 0x3013);
+    labels.AddLabel("DATA", 0x3015);
+    for (const auto &command : kCommandCorpus) {
+        auto opcode = command.substr(0, command.find(' '));
+        benches.push_back({"TranslateCommand/" + opcode, [&translate_assembler, command]() {
+            std::stringstream stream(command);
+            gSink = gSink + AssemblerBenchAccess::TranslateCommand(translate_assembler, stream, 0x3008).size();
+        }});
+    }
+
+    // Label-free instructions through the encode cache and around it
+    EncodeCache encode_cache;
+    AssemblerOptions cached_options, uncached_options;
+    cached_options.encode_cache = &encode_cache;
+    uncached_options.encode_cache = nullptr;
+    assembler cached_assembler(cached_options), uncached_assembler(uncached_options);
+    for (auto *ass : {&cached_assembler, &uncached_assembler}) {
+        auto &ass_labels = AssemblerBenchAccess::Labels(*ass);
+        ass_labels.AddLabel("LOOP", 0x3004);
+        ass_labels.AddLabel("SUB", 0x3013);
+        ass_labels.AddLabel("DATA", 0x3015);
+    }
+    std::vector<LC3Word> words;
+    benches.push_back({"TranslateWords/cached", [&]() {
+        words.clear();
+        AssemblerBenchAccess::TranslateWords(cached_assembler, kLabelFreeCorpus[next++ % kLabelFreeCorpus.size()], words);
+        gSink = gSink + words.size();
+    }});
+    benches.push_back({"TranslateWords/uncached", [&]() {
+        words.clear();
+        AssemblerBenchAccess::TranslateWords(uncached_assembler, kLabelFreeCorpus[next++ % kLabelFreeCorpus.size()], words);
+        gSink = gSink + words.size();
+    }});
+
+    std::vector<Result> results;
+    for (const auto &bench : benches) {
+        if (bench.first.find(filter) == std::string::npos) {
+            continue;
+        }
+        next = 0;
+        results.push_back(Measure(bench.first, samples, bench.second));
+    }
+    return results;
+}
+
+void PrintResults(const std::vector<Result> &results) {
+    std::printf("%-30s %10s %10s %10s %10s\n", "benchmark", "median ns", "mean ns", "stddev", "min ns");
+    for (const auto &result : results) {
+        std::printf("%-30s %10.1f %10.1f %10.1f %10.1f\n", result.name.c_str(), result.median,
+                    result.mean, result.stddev, result.min);
+    }
+}
+
+// Tab separated, one benchmark per line, so runs from two commits can be diffed
+int SaveResults(const std::vector<Result> &results, const std::string &filename) {
+    std::ofstream output_file(filename);
+    if (!output_file) {
+        return -20;
+    }
+    output_file << "# microbench v1 calls_per_sample=" << kCallsPerSample << std::endl;
+    output_file << "# name\tmedian_ns\tmean_ns\tstddev_ns\tmin_ns\tsamples" << std::endl;
+    for (const auto &result : results) {
+        output_file << result.name << '\t' << result.median << '\t' << result.mean << '\t'
+                    << result.stddev << '\t' << result.min << '\t' << result.samples << std::endl;
+    }
+    return 0;
+}
+
+int LoadResults(const std::string &filename, std::vector<Result> &results) {
+    std::ifstream input_file(filename);
+    if (!input_file.is_open()) {
+        return -1;
+    }
+    std::string line;
+    while (std::getline(input_file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::stringstream fields(line);
+        Result result;
+        std::getline(fields, result.name, '\t');
+        fields >> result.median >> result.mean >> result.stddev >> result.min >> result.samples;
+        results.push_back(result);
+    }
+    return 0;
+}
+
+// A benchmark regresses when its median moved by more than the threshold
+// and by more than the noise of both runs
+int CompareResults(const std::string &base_filename, const std::string &new_filename) {
+    std::vector<Result> base, current;
+    if (LoadResults(base_filename, base) != 0 || LoadResults(new_filename, current) != 0) {
+        std::cout << "Unable to open file" << std::endl;
+        return -1;
+    }
+    int regressions = 0;
+    std::printf("%-30s %10s %10s %8s\n", "benchmark", "base ns", "new ns", "change");
+    for (const auto &result : current) {
+        auto match = std::find_if(base.begin(), base.end(),
+                                  [&result](const Result &r) { return r.name == result.name; });
+        if (match == base.end()) {
+            std::printf("%-30s %10s %10.1f %8s\n", result.name.c_str(), "-", result.median, "new");
+            continue;
+        }
+        double change = (result.median - match->median) / match->median;
+        bool regressed = change > kRegressionThreshold &&
+                         result.median - match->median > 2 * (result.stddev + match->stddev);
+        regressions += regressed;
+        std::printf("%-30s %10.1f %10.1f %+7.1f%%%s\n", result.name.c_str(), match->median,
+                    result.median, change * 100, regressed ? "  REGRESSION" : "");
+    }
+    return regressions == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string output_filename, filter;
+    int samples = kDefaultSamples;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "-c" && i + 2 < argc) {
+            return CompareResults(argv[i + 1], argv[i + 2]);
+        } else if (option == "-o" && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (option == "-b" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (option == "-n" && i + 1 < argc) {
+            samples = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cout << "usage: microbench [-n samples] [-b filter] [-o results.tsv]" << std::endl
+                      << "       microbench -c base.tsv new.tsv" << std::endl;
+            return 0;
+        }
+    }
+
+    auto results = RunAll(samples, filter);
+    PrintResults(results);
+    if (!output_filename.empty()) {
+        return SaveResults(results, output_filename);
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * @Description  : read & write relocatable object modules
+ */
+
+#include "object.h"
+#include "pipe_io.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+int WriteObjectModule(const ObjectModule &module, const std::string &filename) {
+    std::ostringstream output_file;
+    output_file << "LC3OBJ 1" << std::endl;
+    output_file << std::hex << std::uppercase << std::setfill('0');
+    for (const auto &section : module.sections) {
+        output_file << "SECTION x" << std::setw(4) << section.origin << " " << std::dec
+                    << section.words.size() << std::hex << std::endl;
+        for (const auto word : section.words) {
+            output_file << std::setw(4) << word << std::endl;
+        }
+    }
+    output_file << std::dec;
+    for (const auto &symbol : module.symbols) {
+        output_file << "SYMBOL " << symbol.name << " " << symbol.section << " " << symbol.offset
+                    << (symbol.exported ? " GLOBAL" : "") << std::endl;
+    }
+    for (const auto &name : module.imports) {
+        output_file << "IMPORT " << name << std::endl;
+    }
+    for (const auto &relocation : module.relocations) {
+        output_file << "RELOC " << relocation.section << " " << relocation.offset << " "
+                    << relocation.width << " " << relocation.symbol << std::endl;
+    }
+    return WriteOutput(filename, output_file.str()); // 文件名为"-"时写到stdout
+}
+
+namespace {
+
+// A hex number of at most `max`, with nothing after it
+bool ParseHex(const std::string &text, unsigned long max, unsigned long &value) {
+    const char *begin = text.c_str();
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtoul(begin, &end, 16);
+    while (*end == ' ' || *end == '\r') {
+        ++end;
+    }
+    return end != begin && *end == '\0' && errno == 0 && value <= max && text[0] != '-';
+}
+
+} // namespace
+
+int ReadObjectModule(const std::string &filename, ObjectModule &module) {
+    std::ifstream input_file(filename);
+    if (!input_file.is_open()) {
+        // @ Input file read error
+        return -1;
+    }
+    std::string line;
+    if (!std::getline(input_file, line) || line != "LC3OBJ 1") {
+        // @ Error not an object file
+        return -50;
+    }
+    while (std::getline(input_file, line)) {
+        std::stringstream record(line);
+        std::string kind;
+        record >> kind;
+        if (kind == "SECTION") {
+            std::string origin;
+            size_t count = 0;
+            record >> origin >> count;
+            unsigned long value = 0;
+            if (!record || origin.size() < 2 || origin[0] != 'x' ||
+                !ParseHex(origin.substr(1), 0xFFFF, value) || count > 0x10000) {
+                // @ Error bad section header
+                return -51;
+            }
+            ObjectSection section;
+            section.origin = (unsigned)value;
+            section.words.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                if (!std::getline(input_file, line)) {
+                    // @ Error truncated section
+                    return -51;
+                }
+                if (!ParseHex(line, 0xFFFF, value)) {
+                    // @ Error bad word
+                    return -51;
+                }
+                section.words.push_back((LC3Word)value);
+            }
+            module.sections.push_back(std::move(section));
+        } else if (kind == "SYMBOL") {
+            ObjectSymbol symbol;
+            std::string flag;
+            record >> symbol.name >> symbol.section >> symbol.offset;
+            if (!record || symbol.section >= module.sections.size() ||
+                symbol.offset > module.sections[symbol.section].words.size()) {
+                // @ Error bad symbol record
+                return -51;
+            }
+            record >> flag;
+            symbol.exported = flag == "GLOBAL";
+            module.symbols.push_back(symbol);
+        } else if (kind == "IMPORT") {
+            std::string name;
+            record >> name;
+            module.imports.push_back(name);
+        } else if (kind == "RELOC") {
+            ObjectRelocation relocation;
+            record >> relocation.section >> relocation.offset >> relocation.width >> relocation.symbol;
+            if (!record || relocation.section >= module.sections.size() ||
+                relocation.offset >= module.sections[relocation.section].words.size() ||
+                relocation.width < 1 || relocation.width > 16) {
+                // @ Error bad relocation record
+                return -52;
+            }
+            module.relocations.push_back(relocation);
+        } else if (!kind.empty()) {
+            // @ Error unknown record
+            return -51;
+        }
+    }
+    return 0;
+}
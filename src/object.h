@@ -0,0 +1,58 @@
+/*
+ * @Description  : relocatable object modules shared by assembler and linker
+ *
+ * Object file layout (text, one record per line):
+ *   LC3OBJ 1
+ *   SECTION <origin> <word count>     followed by one hex word per line
+ *   SYMBOL <name> <section> <offset> [GLOBAL]
+ *   IMPORT <name>
+ *   RELOC <section> <offset> <width> <symbol>
+ * A RELOC asks the linker to store the PC-relative offset of <symbol> in the
+ * low <width> bits of the word at <offset> in <section>.
+ */
+
+#ifndef ASSEMBLER_OBJECT_H
+#define ASSEMBLER_OBJECT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef std::uint16_t LC3Word; // LC3机器字
+
+struct ObjectSection
+{
+    unsigned origin;            // .ORIG给出的起始地址
+    std::vector<LC3Word> words; // 段内机器字
+};
+
+struct ObjectSymbol
+{
+    std::string name;
+    size_t section;
+    unsigned offset;  // 相对段起始地址的偏移
+    bool exported;    // 是否由.GLOBAL导出
+};
+
+struct ObjectRelocation
+{
+    size_t section;
+    unsigned offset;
+    int width;          // PCoffset字段位数(9或11)
+    std::string symbol; // 目标标签
+};
+
+struct ObjectModule
+{
+    std::vector<ObjectSection> sections;
+    std::vector<ObjectSymbol> symbols;
+    std::vector<std::string> imports;
+    std::vector<ObjectRelocation> relocations;
+};
+
+const std::string kObjectExtension = ".rel"; // 目标文件扩展名
+
+int WriteObjectModule(const ObjectModule &module, const std::string &filename);
+int ReadObjectModule(const std::string &filename, ObjectModule &module);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * @Description  : minimal thread fan-out helper
+ */
+
+#ifndef ASSEMBLER_PARALLEL_H
+#define ASSEMBLER_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Hardware threads, never less than one
+inline unsigned DefaultThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run job(0) .. job(job_count - 1) on up to `thread_count` threads (the
+// calling thread included); jobs are handed out one at a time so uneven
+// jobs still balance. A job that throws stops the hand-out; every thread is
+// joined before the first exception is rethrown on the calling thread.
+template <class Job>
+void ParallelFor(size_t job_count, unsigned thread_count, Job job)
+{
+    std::atomic<size_t> next_job(0);
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto worker = [&]() {
+        try
+        {
+            for (size_t i = next_job++; i < job_count; i = next_job++)
+            {
+                job(i);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure)
+            {
+                failure = std::current_exception();
+            }
+            next_job = job_count; // 不再分发新的任务
+        }
+    };
+    size_t worker_count = std::min<size_t>(job_count, std::max(1u, thread_count));
+    std::vector<std::thread> threads;
+    try
+    {
+        threads.reserve(worker_count);
+        for (size_t i = 1; i < worker_count; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+    }
+    catch (...)
+    {
+        // fewer threads than asked for: the calling thread runs what is left
+    }
+    worker();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+#endif
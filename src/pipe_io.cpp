@@ -0,0 +1,148 @@
+/*
+ * @Description  : whole-file input and output, including stdin/stdout pipes
+ */
+
+#include "pipe_io.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kReadBlock = 1 << 16;   // 管道每次读取的字节数
+const int kPipeSize = 1 << 20;       // 尽量放大stdout管道, 减少vmsplice次数
+
+int WriteAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -20;
+        }
+        data += written;
+        size -= written;
+    }
+    return 0;
+}
+
+// Hand the pages to the pipe instead of copying them; vmsplice() blocks
+// while the pipe is full and returns how much it took
+int SpliceAll(int fd, const char *data, size_t size) {
+    fcntl(fd, F_SETPIPE_SZ, kPipeSize); // best effort
+    while (size > 0) {
+        struct iovec block = {const_cast<char *>(data), size};
+        ssize_t spliced = vmsplice(fd, &block, 1, 0);
+        if (spliced < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -20;
+        }
+        data += spliced;
+        size -= spliced;
+    }
+    return 0;
+}
+
+} // namespace
+
+InputBuffer::~InputBuffer() {
+    if (mapped_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+int InputBuffer::open(const std::string &filename, size_t max_size) {
+    int fd = IsStdioFilename(filename) ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    int status = fstat(fd, &info) == 0 ? 0 : -1;
+    if (status == 0 && S_ISREG(info.st_mode) && max_size != 0 && (size_t)info.st_size > max_size) {
+        status = -2;
+    } else if (status == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        // a regular file (also stdin redirected from one) is mapped as is
+        void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data_ = static_cast<const char *>(map);
+            size_ = info.st_size;
+            mapped_ = true;
+        } else {
+            status = -1;
+        }
+    } else if (status == 0) {
+        // pipes, terminals and empty files: read until end of file
+        while (true) {
+            size_t used = read_.size();
+            read_.resize(used + kReadBlock);
+            ssize_t count = read(fd, read_.data() + used, kReadBlock);
+            if (count < 0 && errno == EINTR) {
+                read_.resize(used);
+                continue;
+            }
+            read_.resize(used + std::max<ssize_t>(count, 0));
+            if (count <= 0) {
+                status = count < 0 ? -1 : 0;
+                break;
+            }
+            if (max_size != 0 && read_.size() > max_size) {
+                status = -2;
+                break;
+            }
+        }
+        data_ = read_.data();
+        size_ = read_.size();
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return status;
+}
+
+OutputBuffer::OutputBuffer(size_t size) : size_(size) {
+    if (size > 0) {
+        void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        data_ = map == MAP_FAILED ? nullptr : static_cast<char *>(map);
+    }
+}
+
+OutputBuffer::~OutputBuffer() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+int WriteOutput(const std::string &filename, const OutputBuffer &buffer) {
+    if (IsStdioFilename(filename)) {
+        struct stat info;
+        if (fstat(STDOUT_FILENO, &info) == 0 && S_ISFIFO(info.st_mode)) {
+            return SpliceAll(STDOUT_FILENO, buffer.data(), buffer.size());
+        }
+        return WriteAll(STDOUT_FILENO, buffer.data(), buffer.size());
+    }
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        // @ Error at output file
+        return -20;
+    }
+    int status = WriteAll(fd, buffer.data(), buffer.size());
+    return close(fd) == 0 ? status : -20;
+}
+
+int WriteOutput(const std::string &filename, const std::string &text) {
+    OutputBuffer buffer(text.size());
+    if (!buffer.ok()) {
+        // @ Error at output file
+        return -20;
+    }
+    std::memcpy(buffer.data(), text.data(), text.size());
+    return WriteOutput(filename, buffer);
+}
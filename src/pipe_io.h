@@ -0,0 +1,85 @@
+/*
+ * @Description  : whole-file input and output, including stdin/stdout pipes
+ *
+ * The file name "-" stands for stdin as input and stdout as output, so the
+ * assembler can sit in a shell pipeline without temp files. Input is held
+ * in memory (a regular file is mapped, a pipe is read in large blocks) and
+ * output is built in page-aligned memory that is handed to a stdout pipe
+ * with vmsplice() instead of being copied through iostream buffers.
+ */
+
+#ifndef ASSEMBLER_PIPE_IO_H
+#define ASSEMBLER_PIPE_IO_H
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+inline bool IsStdioFilename(const std::string &filename)
+{
+    return filename == "-";
+}
+
+// The whole content of an input file or of stdin
+class InputBuffer
+{
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;    // 是否为文件映射
+    std::vector<char> read_; // 管道读入的内容
+
+public:
+    InputBuffer() = default;
+    ~InputBuffer();
+    InputBuffer(const InputBuffer &) = delete;
+    InputBuffer &operator=(const InputBuffer &) = delete;
+
+    // 0 on success, -1 if unreadable, -2 if longer than a non-zero `max_size`
+    // (a pipe is read no further than that)
+    int open(const std::string &filename, size_t max_size = 0);
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// Read-only std::streambuf over a block of memory, without a copy
+class MemoryStreambuf : public std::streambuf
+{
+public:
+    MemoryStreambuf(const char *data, size_t size)
+    {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Page-aligned anonymous memory for a whole output file. Pages given to a
+// pipe with vmsplice() are only referenced, so they are never written again
+// once handed over; unmapping them afterwards is safe.
+class OutputBuffer
+{
+private:
+    char *data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit OutputBuffer(size_t size);
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    bool ok() const { return size_ == 0 || data_ != nullptr; }
+    char *data() { return data_; }
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// Write `buffer` to `filename` ("-" for stdout): vmsplice() into a stdout
+// pipe, plain write() otherwise. 0 on success, -20 on an output error.
+int WriteOutput(const std::string &filename, const OutputBuffer &buffer);
+
+// The same for text built in a string (symbol table, listing, .rel)
+int WriteOutput(const std::string &filename, const std::string &text);
+
+#endif
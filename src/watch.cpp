@@ -0,0 +1,399 @@
+/*
+ * @Description  : watch mode, incremental reassembly of edited sources
+ */
+
+#include "watch.h"
+#include <chrono>
+#include <climits>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+incremental_assembly::incremental_assembly(const std::string &source, const std::string &output,
+                                           const AssemblerOptions &options)
+    : source_filename(source), output_filename(output), ass(options) {
+    output_fd = open(output_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+}
+
+incremental_assembly::~incremental_assembly() {
+    if (output_fd >= 0) {
+        close(output_fd);
+    }
+}
+
+// The per-line part of firstPass: format, split the label, classify and size
+void incremental_assembly::parseLine(SourceLine &line) {
+    std::string formatted = line.raw;
+    formatted = FormatLine(formatted);
+    if (formatted.empty()) {
+        return;
+    }
+
+    auto first_whitespace_position = formatted.find(' ');
+    auto first_token = formatted.substr(0, first_whitespace_position);
+    line.command = formatted;
+    if (IsLC3Pseudo(first_token) == -1 && IsLC3Command(first_token) == -1 &&
+        IsLC3TrapRoutine(first_token) == -1) {
+        // * This is a label
+        line.label = first_token;
+        if (first_whitespace_position == std::string::npos) {
+            return;
+        }
+        line.command = formatted.substr(first_whitespace_position + 1);
+        line.command = Trim(line.command);
+        first_whitespace_position = line.command.find(' ');
+        first_token = line.command.substr(0, first_whitespace_position);
+    }
+    if (line.command.empty()) {
+        return;
+    }
+
+    auto operand = line.command.substr(first_whitespace_position + 1);
+    if (first_token == ".ORIG") {
+        line.kind = ORIG;
+        line.value = RecognizeNumberValue(operand);
+        if (line.value == std::numeric_limits<int>::max()) {
+            // @ Error orig address
+            line.status = -2;
+        }
+        return;
+    }
+    if (first_token == ".END") {
+        line.kind = END;
+        return;
+    }
+    if (first_token == ".EXTERNAL" || first_token == ".GLOBAL") {
+        return; // only meaningful for relocatable objects
+    }
+
+    line.kind = CODE;
+    if (IsLC3Command(first_token) != -1 || IsLC3TrapRoutine(first_token) != -1) {
+        line.type = CommandType::OPERATION;
+        line.word_count = 1;
+        std::stringstream operand_stream(line.command);
+        std::string token;
+        operand_stream >> token; // opcode
+        while (operand_stream >> token) {
+            line.operands.push_back(token);
+        }
+        return;
+    }
+
+    line.type = CommandType::PSEUDO;
+    line.word_count = assembler::CommandWordCount(
+        {0, line.command.data(), line.command.size(), CommandType::PSEUDO});
+    line.status = PseudoOperandStatus(first_token, operand);
+}
+
+// The address part of firstPass over the whole line table. This is integer
+// work only; labels are moved in place unless the set of label definitions
+// changed, in which case the symbol table is rebuilt.
+int incremental_assembly::layoutLines(bool labels_changed, bool &labels_moved) {
+    int orig_address = -1;
+    int current_address = -1;
+    bool section_ended = false;
+    bool section_has_words = false; // 当前段是否已有输出字
+    int next_address = -1;          // 上一段输出字之后的地址, -1表示还没有输出字
+    std::vector<int> old_addresses;
+    old_addresses.reserve(lines.size());
+
+    for (auto &line : lines) {
+        old_addresses.push_back(line.address);
+        bool had_label = !line.label.empty() && line.address != INT_MIN;
+        line.active = false;
+        line.address = current_address;
+
+        if (section_ended && line.kind != ORIG) {
+            // ignored between .END and the next .ORIG
+            line.address = INT_MIN;
+            labels_changed = labels_changed || had_label;
+            continue;
+        }
+        labels_changed = labels_changed || (!line.label.empty() && !had_label);
+        if (line.status != 0) {
+            labels_dirty = true; // addresses are half updated, rebuild next time
+            return line.status;
+        }
+        switch (line.kind) {
+        case ORIG:
+            orig_address = line.value;
+            current_address = orig_address;
+            section_ended = false;
+            section_has_words = false;
+            break;
+        case END:
+            if (orig_address == -1) {
+                // @ Error Program begins before .ORIG
+                labels_dirty = true;
+                return -3;
+            }
+            section_ended = true;
+            break;
+        case CODE:
+            if (orig_address == -1) {
+                // @ Error Program begins before .ORIG
+                labels_dirty = true;
+                return -3;
+            }
+            if (line.word_count != 0 && !section_has_words) {
+                if (next_address != -1 && line.address != next_address) {
+                    // @ Error sections are not contiguous, the text output has no addresses
+                    labels_dirty = true;
+                    return -23;
+                }
+                section_has_words = true;
+            }
+            line.active = true;
+            current_address += line.word_count;
+            if (line.word_count != 0) {
+                next_address = current_address;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    labels_moved = false;
+    if (labels_changed || labels_dirty) {
+        labels_dirty = false;
+        ass.label_map.Clear();
+        for (auto &line : lines) {
+            line.owns_label = false;
+            if (!line.label.empty() && line.address != INT_MIN &&
+                ass.label_map.GetAddress(line.label) == -1) {
+                ass.label_map.AddLabel(line.label, line.address);
+                line.owns_label = true;
+            }
+        }
+        labels_moved = true;
+        return 0;
+    }
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (lines[i].owns_label && lines[i].address != old_addresses[i]) {
+            ass.label_map.SetAddress(lines[i].label, lines[i].address);
+            labels_moved = true;
+        }
+    }
+    return 0;
+}
+
+// Offsets from the line to each operand that names a label (INT_MIN for
+// operands that are not labels); the encoding only depends on these
+std::vector<int> incremental_assembly::labelOffsets(const SourceLine &line) const {
+    std::vector<int> offsets;
+    for (const auto &operand : line.operands) {
+        int address = ass.label_map.GetAddress(operand);
+        offsets.push_back(address == -1 ? INT_MIN : address - line.address);
+    }
+    return offsets;
+}
+
+int incremental_assembly::update() {
+    reparsed_lines = reencoded_lines = written_bytes = 0;
+    if (output_fd < 0) {
+        // @ Error at output file
+        return -20;
+    }
+    std::ifstream input_file(source_filename);
+    if (!input_file.is_open()) {
+        // @ Input file read error
+        return -1;
+    }
+    std::vector<std::string> source;
+    std::string raw;
+    while (std::getline(input_file, raw)) {
+        source.push_back(raw);
+    }
+
+    // Only the range between the common prefix and suffix was edited
+    size_t common = std::min(lines.size(), source.size());
+    size_t prefix = 0;
+    while (prefix < common && lines[prefix].raw == source[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix &&
+           lines[lines.size() - 1 - suffix].raw == source[source.size() - 1 - suffix]) {
+        ++suffix;
+    }
+
+    bool labels_changed = false;
+    for (size_t i = prefix; i < lines.size() - suffix; ++i) {
+        labels_changed = labels_changed || !lines[i].label.empty();
+    }
+    std::vector<SourceLine> edited(source.size() - suffix - prefix);
+    for (size_t i = 0; i < edited.size(); ++i) {
+        edited[i].raw = std::move(source[prefix + i]);
+        parseLine(edited[i]);
+        edited[i].address = INT_MIN;                    // not laid out yet
+        edited[i].output_offset = std::string::npos;     // not in the output yet
+        labels_changed = labels_changed || !edited[i].label.empty();
+    }
+    reparsed_lines = edited.size();
+    lines.erase(lines.begin() + prefix, lines.end() - suffix);
+    lines.insert(lines.begin() + prefix, std::make_move_iterator(edited.begin()),
+                 std::make_move_iterator(edited.end()));
+
+    bool labels_moved = false;
+    auto layout_status = layoutLines(labels_changed, labels_moved);
+    if (layout_status != 0) {
+        return layout_status;
+    }
+
+    // Re-encode what changed, then lay the output text out again
+    int translate_status = 0;
+    std::vector<char> text_changed(lines.size(), 0);
+    size_t first_shift = lines.size();
+    size_t output_size = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        auto &line = lines[i];
+        if (!line.active) {
+            // outside any section: no output, encode again if it comes back
+            text_changed[i] = !line.text.empty();
+            line.text.clear();
+            line.encoded = false;
+        } else if (!line.encoded ||
+                   (line.type == CommandType::OPERATION &&
+                    (labels_moved || line.address != line.encoded_address) &&
+                    labelOffsets(line) != line.label_offsets)) {
+            std::string text;
+            try {
+                text = ass.TranslateLine(
+                    {(unsigned)line.address, line.command.data(), line.command.size(), line.type});
+            } catch (const std::exception &) {
+                // @ Error the line could not be encoded at all
+                ass.translate_status = -32;
+            }
+            bool translated = ass.translate_status == 0;
+            if (!translated) {
+                // bad instruction: leave it out of the output, retry on the next update
+                translate_status = ass.translate_status;
+                ass.translate_status = 0;
+                text.clear();
+            }
+            text_changed[i] = !line.encoded || text != line.text;
+            line.text = std::move(text);
+            line.label_offsets = labelOffsets(line);
+            line.encoded = translated;
+            line.encoded_address = line.address;
+            ++reencoded_lines;
+        }
+        // edited lines are written anyway; a shift shows on the retained lines
+        if (first_shift == lines.size() && line.output_offset != std::string::npos &&
+            line.output_offset != output_size) {
+            first_shift = i;
+        }
+        line.output_offset = output_size;
+        output_size += line.text.size();
+    }
+
+    // Lines before the first shifted one are rewritten in place, everything
+    // from there on is one contiguous write
+    for (size_t i = 0; i < first_shift; ++i) {
+        if (text_changed[i] && !lines[i].text.empty()) {
+            if (pwrite(output_fd, lines[i].text.data(), lines[i].text.size(), lines[i].output_offset) < 0) {
+                return -20;
+            }
+            written_bytes += lines[i].text.size();
+        }
+    }
+    if (first_shift < lines.size()) {
+        std::string tail;
+        tail.reserve(output_size - lines[first_shift].output_offset);
+        for (size_t i = first_shift; i < lines.size(); ++i) {
+            tail += lines[i].text;
+        }
+        if (pwrite(output_fd, tail.data(), tail.size(), lines[first_shift].output_offset) < 0) {
+            return -20;
+        }
+        written_bytes += tail.size();
+    }
+    if (ftruncate(output_fd, output_size) != 0) {
+        return -20;
+    }
+    return translate_status;
+}
+
+namespace {
+
+void ReportUpdate(const incremental_assembly &build, int status, double milliseconds) {
+    std::cout << build.source() << ": " << status << " (" << build.reparsed_lines << " lines reparsed, "
+              << build.reencoded_lines << " re-encoded, " << build.written_bytes << " bytes written, "
+              << milliseconds << " ms)" << std::endl;
+}
+
+void UpdateAndReport(incremental_assembly &build) {
+    auto start = std::chrono::steady_clock::now();
+    auto status = build.update();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    ReportUpdate(build, status, elapsed.count());
+}
+
+std::pair<std::string, std::string> SplitPath(const std::string &path) {
+    auto slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return {".", path};
+    }
+    return {slash == 0 ? "/" : path.substr(0, slash), path.substr(slash + 1)};
+}
+
+} // namespace
+
+int WatchFiles(const std::vector<std::pair<std::string, std::string>> &files,
+               const AssemblerOptions &options) {
+    std::vector<std::unique_ptr<incremental_assembly>> builds;
+    for (const auto &file : files) {
+        builds.emplace_back(new incremental_assembly(file.first, file.second, options));
+        UpdateAndReport(*builds.back());
+    }
+
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        // @ Error inotify unavailable
+        return -70;
+    }
+    // Watch directories rather than files: editors often save by renaming a
+    // temporary file over the source
+    std::unordered_map<int, std::string> watched_dirs;
+    for (const auto &build : builds) {
+        auto dir = SplitPath(build->source()).first;
+        int wd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            close(inotify_fd);
+            return -70;
+        }
+        watched_dirs[wd] = dir;
+    }
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            close(inotify_fd);
+            return -70;
+        }
+        // One update per touched file, however many events the save produced
+        std::vector<char> touched(builds.size(), 0);
+        for (char *ptr = buffer; ptr < buffer + length;) {
+            auto *event = reinterpret_cast<struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < builds.size(); ++i) {
+                auto path = SplitPath(builds[i]->source());
+                if (path.first == watched_dirs[event->wd] && path.second == event->name) {
+                    touched[i] = 1;
+                }
+            }
+        }
+        for (size_t i = 0; i < builds.size(); ++i) {
+            if (touched[i]) {
+                UpdateAndReport(*builds[i]);
+            }
+        }
+    }
+}
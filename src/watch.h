@@ -0,0 +1,81 @@
+/*
+ * @Description  : watch mode, incremental reassembly of edited sources
+ */
+
+#ifndef ASSEMBLER_WATCH_H
+#define ASSEMBLER_WATCH_H
+
+#include "assembler.h"
+
+// Keeps the line table, symbol table and output text of the previous build
+// of one source file. update() diffs the new source against the previous
+// one, reparses only the edited line range, shifts the addresses after it,
+// re-encodes only lines whose text changed or whose label targets moved
+// relative to them, and rewrites only the affected bytes of the output.
+class incremental_assembly
+{
+    enum LineKind
+    {
+        EMPTY,  // 空行/注释行/仅含标签
+        ORIG,   // .ORIG
+        END,    // .END
+        CODE    // 指令或占用内存的伪指令
+    };
+
+    struct SourceLine
+    {
+        std::string raw;                   // 原始源代码行
+        LineKind kind = EMPTY;
+        std::string label;                 // 本行定义的标签
+        std::string command;               // 去除标签后的指令
+        CommandType type = OPERATION;
+        int value = 0;                     // .ORIG地址
+        size_t word_count = 0;
+        int status = 0;                    // 本行的第一遍扫描错误码
+        std::vector<std::string> operands; // 可能是标签的操作数
+        bool owns_label = false;           // 是否为该标签的首次定义
+        int address = -1;
+        bool active = false;               // 是否在某个.ORIG/.END段内
+        // State of the last encoding
+        bool encoded = false;
+        int encoded_address = -1;
+        std::vector<int> label_offsets;    // 各操作数标签相对本行的偏移, 非标签为INT_MIN
+        std::string text;                  // 本行输出文本(含换行)
+        size_t output_offset = 0;
+    };
+
+private:
+    std::string source_filename;
+    std::string output_filename;
+    int output_fd = -1;
+    assembler ass;
+    std::vector<SourceLine> lines;
+    bool labels_dirty = false; // 上次布局中途失败, 需重建符号表
+
+    void parseLine(SourceLine &line);
+    int layoutLines(bool labels_changed, bool &labels_moved);
+    std::vector<int> labelOffsets(const SourceLine &line) const;
+
+public:
+    // Counters of the last update, for the feedback line
+    size_t reparsed_lines = 0;
+    size_t reencoded_lines = 0;
+    size_t written_bytes = 0;
+
+    incremental_assembly(const std::string &source, const std::string &output,
+                         const AssemblerOptions &options);
+    ~incremental_assembly();
+    incremental_assembly(const incremental_assembly &) = delete;
+    incremental_assembly &operator=(const incremental_assembly &) = delete;
+
+    const std::string &source() const { return source_filename; }
+    int update(); // 重新读取源文件并增量汇编, 返回状态码
+};
+
+// Assemble every (source, output) pair once, then reassemble incrementally
+// whenever inotify reports that a source was written. Never returns on
+// success.
+int WatchFiles(const std::vector<std::pair<std::string, std::string>> &files,
+               const AssemblerOptions &options);
+
+#endif